@@ -33,7 +33,7 @@
 extern "C" {
 #endif
 
-#define TABBY_VERSION 4
+#define TABBY_VERSION 5
 
 /*
  * Verify binary compatibility with the Tabby API on startup.
@@ -95,12 +95,131 @@ extern int tabby_client_rekey(const tabby_client *existing, tabby_client *C, con
  */
 extern int tabby_client_handshake(tabby_client *C, const char server_public_key[64], const char server_response[128], char secret_key[32]);
 
+/*
+ * Process a batch of server responses
+ *
+ * This is equivalent to calling tabby_client_handshake() on each client in
+ * turn, and it is NOT meaningfully faster.  The only work the handshakes can
+ * share is the final inversion of each point multiplication, which saves a
+ * few percent of a handshake; the constant-time point multiplications make
+ * up nearly all of the cost and cannot be shared.  It is provided for
+ * clients that connect to many servers at once and want a single call.
+ * Clients that connect to the same server many times should use
+ * tabby_server_key_gen() and tabby_client_handshake_key() instead.
+ *
+ * C is an array of count client objects, one for each server.  The server
+ * public keys, responses, and secret keys are packed back-to-back in the
+ * buffers: server_public_keys is count * 64 bytes, server_responses is
+ * count * 128 bytes, and secret_keys is count * 32 bytes.
+ *
+ * If results is not NULL, then it should have room for count integers, and
+ * each is set to 0 if the corresponding handshake succeeded or non-zero if
+ * its server response was invalid.  Only the secret keys of successful
+ * entries are written.
+ *
+ * Returns 0 if all of the handshakes succeeded.
+ * Returns non-zero if any of the input data is invalid.
+ */
+extern int tabby_client_handshake_batch(int count, tabby_client *C, const char *server_public_keys, const char *server_responses, char *secret_keys, int *results);
+
+// Opaque server public key object
+typedef struct {
+	char internal[96];
+} tabby_server_key;
+
+/*
+ * Precompute a server public key for client handshakes
+ *
+ * Clients that connect to the same server many times, such as devices with
+ * a pinned server key or load generators, can validate the key once and
+ * precompute 48 KB of tables for it.  tabby_client_handshake_key() is then
+ * 5-10% faster than tabby_client_handshake(), depending on how much of the
+ * tables stays in cache between handshakes.
+ *
+ * The object must be freed with tabby_server_key_free().
+ *
+ * Returns 0 on success.
+ * Returns non-zero if the public key is invalid or out of memory.
+ */
+extern int tabby_server_key_gen(tabby_server_key *K, const char server_public_key[64]);
+
+/*
+ * Process server response with a precomputed server public key
+ *
+ * Same as tabby_client_handshake().  The server key object is only read, so
+ * it can be shared between threads.
+ *
+ * Returns 0 on success.
+ * Returns non-zero if the input data is invalid.
+ */
+extern int tabby_client_handshake_key(tabby_client *C, const tabby_server_key *K, const char server_response[128], char secret_key[32]);
+
+/*
+ * Free a server public key object
+ */
+extern void tabby_server_key_free(tabby_server_key *K);
+
+// Opaque client key pair pool object
+typedef struct {
+	char internal[192];
+} tabby_client_pool;
+
+/*
+ * Generate a pool of client key pairs for connecting without delay
+ *
+ * Each entry holds an ephemeral key pair and nonce, generated in batches.
+ * The count is rounded up to a power of two, up to 65536.  The pool is
+ * filled before this returns.
+ *
+ * One thread may fill the pool while another pops from it.  Popping from
+ * more than one thread at a time requires external locking.
+ *
+ * The object must be freed with tabby_client_pool_free().
+ *
+ * Returns 0 on success.
+ * Returns non-zero if the input is invalid or out of memory.
+ */
+extern int tabby_client_pool_gen(tabby_client_pool *P, int count, const void *seed, int seed_bytes);
+
+/*
+ * Refill the client key pool
+ *
+ * This is meant to be called from a background thread after pops.  It does
+ * not gather new entropy.  If another fill is in progress it returns at once.
+ *
+ * Returns 0 on success.
+ * Returns non-zero if the input is invalid.
+ */
+extern int tabby_client_pool_fill(tabby_client_pool *P);
+
+/*
+ * Initialize a client object from the next pooled key pair
+ *
+ * This replaces tabby_client_gen() or tabby_client_rekey() on the connect
+ * path.  The client object is then used with tabby_client_handshake() as
+ * usual and should be erased with tabby_erase() after use.
+ *
+ * Returns 0 on success.
+ * Returns non-zero if the pool is empty or the input is invalid.
+ */
+extern int tabby_client_pool_pop(tabby_client_pool *P, tabby_client *C, char client_request[96]);
+
+/*
+ * Returns the number of key pairs ready to pop, or -1 on invalid input
+ */
+extern int tabby_client_pool_size(tabby_client_pool *P);
+
+/*
+ * Free a client key pool, erasing any unused key pairs
+ */
+extern void tabby_client_pool_free(tabby_client_pool *P);
+
 
 //// Server
 
 // Opaque server state object
 typedef struct {
-	char internal[464];
+	char internal[2560];
 } tabby_server;
 
 /*
@@ -118,7 +237,15 @@ extern int tabby_server_gen(tabby_server *S, const void *seed, int seed_bytes);
  * Rekey a Tabby server object
  *
  * This should be done no more often than once per minute, and optimally
- * from a separate thread since it can take a minute to complete.
+ * from a separate thread since it can take a minute to complete.  Or use
+ * tabby_server_rekey_start() to have Tabby run the thread.
+ *
+ * The new ephemeral key is used for handshakes as soon as it is published.
+ * Handshakes already running keep using the old key in place, so this waits
+ * a 10 millisecond grace period for them before erasing the old ephemeral
+ * secret and returning.  It is safe to call this while other threads are
+ * processing handshakes.  If another rekey is in progress, this returns 0
+ * without doing anything.
  *
  * You may optionally provide extra random number data as a seed to improve
  * the quality of the generated keys; otherwise pass NULL for seed.
@@ -128,6 +255,35 @@ extern int tabby_server_gen(tabby_server *S, const void *seed, int seed_bytes);
  */
 extern int tabby_server_rekey(tabby_server *S, const void *seed, int seed_bytes);
 
+/*
+ * Start a background thread that rekeys the server periodically
+ *
+ * The thread calls tabby_server_rekey() every interval_msec milliseconds.
+ * If the ephemeral key pool is enabled, it calls tabby_server_rotate() and
+ * then tabby_server_pool_fill() instead, changes the cookie key, and erases
+ * the old ephemeral secret after the grace period.  Pass 0 for interval_msec
+ * to use the default of one minute.
+ *
+ * The thread must be stopped with tabby_server_rekey_stop() before the
+ * server object is erased or goes out of scope.
+ *
+ * Returns 0 on success.
+ * Returns non-zero if the input data is invalid or the thread is running.
+ */
+extern int tabby_server_rekey_start(tabby_server *S, int interval_msec);
+
+/*
+ * Stop the background rekey thread
+ *
+ * Blocks until the thread exits, which may take a while if the thread is
+ * waiting for entropy to reseed.  It is safe to call this if the thread was
+ * never started.
+ *
+ * Returns 0 on success.
+ * Returns non-zero if the input data is invalid.
+ */
+extern int tabby_server_rekey_stop(tabby_server *S);
+
 /*
  * Returns the public key for a Tabby server object
  *
@@ -170,12 +326,424 @@ extern int tabby_server_load_secret(tabby_server *S, const void *seed, int seed_
  * server, and the server believes a session is established.  Ideally in
  * this case, the next time the client sends an identical request, the
  * server would send its response again without calling this function.
+ * The replay cache enabled by tabby_server_cache_enable() does this.
  *
  * Returns 0 on success.
  * Returns non-zero if the input data is invalid.
  */
 extern int tabby_server_handshake(tabby_server *S, const char client_request[96], char server_response[128], char secret_key[32]);
 
+/*
+ * Process a batch of client requests
+ *
+ * This is equivalent to calling tabby_server_handshake() on each request in
+ * turn, but it is faster because the requests share some of the work.  It is
+ * useful for servers that receive many handshake requests at once.
+ *
+ * The requests, responses, and keys are packed back-to-back in the buffers:
+ * client_requests is count * 96 bytes, server_responses is count * 128 bytes,
+ * and secret_keys is count * 32 bytes.
+ *
+ * If results is not NULL, then it should have room for count integers, and
+ * each is set to 0 if the corresponding handshake succeeded or non-zero if
+ * its request was invalid.  Failed entries should not be sent to the client.
+ *
+ * Returns 0 if all of the handshakes succeeded.
+ * Returns non-zero if any of the input data is invalid.
+ */
+extern int tabby_server_handshake_batch(tabby_server *S, int count, const char *client_requests, char *server_responses, char *secret_keys, int *results);
+
+/*
+ * Enable the replay cache for lost server responses
+ *
+ * After this is called, the handshake functions remember recent responses.
+ * When a client sends the same request again because the response was lost,
+ * the same response and secret key are returned without redoing the math.
+ *
+ * The cache holds the given number of entries, rounded up to a power of two,
+ * and at most 2^22 entries.  Each entry takes about 280 bytes.  Newer requests replace older ones.
+ * After the server is rekeyed, cached responses for the old ephemeral key
+ * are no longer returned, and their secret keys are erased as the entries
+ * are reused, or when the cache is disabled.
+ *
+ * This function is not thread-safe: call it before starting workers.
+ *
+ * Returns 0 on success.
+ * Returns non-zero if the input data is invalid or out of memory.
+ */
+extern int tabby_server_cache_enable(tabby_server *S, int entries);
+
+/*
+ * Disable the replay cache and free its memory
+ *
+ * The cached secret keys are securely erased.  This function is not thread-
+ * safe: call it after stopping workers and the rekey thread.
+ *
+ * Returns 0 on success.
+ * Returns non-zero if the input data is invalid.
+ */
+extern int tabby_server_cache_free(tabby_server *S);
+
+/*
+ * Enable a pool of pre-generated ephemeral keys
+ *
+ * With a pool enabled, ephemeral key pairs are generated ahead of time in
+ * batches, and tabby_server_rotate() switches to the next one by copying it
+ * into place.  Rotating takes about a microsecond and does not wait for
+ * entropy, unlike tabby_server_rekey().
+ *
+ * The pool holds the given number of key pairs, rounded up to a power of
+ * two, and it is filled before this function returns.  Each entry takes 136
+ * bytes.
+ *
+ * If rotate_handshakes is non-zero, the server also rotates after every
+ * rotate_handshakes handshakes.  The thread that processes the handshake
+ * crossing the count does the rotation.  The server keeps the last eight
+ * keys around for handshakes still using them, so at most about six
+ * rotations fit in the 10 millisecond grace period, and a rotation that
+ * would come sooner is skipped.  Pass 0 to rotate only on request or from
+ * the rekey thread.
+ *
+ * Rotations do not change the cookie key, which only changes with
+ * tabby_server_rekey() and the rekey thread.  Each pooled key does bring
+ * its own resumption ticket key, so frequent rotations also expire tickets
+ * sooner.
+ *
+ * This function is not thread-safe: call it before starting workers and the
+ * rekey thread.
+ *
+ * Returns 0 on success.
+ * Returns non-zero if the input data is invalid or out of memory.
+ */
+extern int tabby_server_pool_enable(tabby_server *S, int count, int rotate_handshakes);
+
+/*
+ * Refill the pool of pre-generated ephemeral keys
+ *
+ * This can take a while, since it reseeds the pool generator.  It is safe to
+ * call this while other threads are processing handshakes and rotating.  If
+ * another fill is in progress, this returns 0 without doing anything.
+ *
+ * You may optionally provide extra random number data as a seed to improve
+ * the quality of the generated keys; otherwise pass NULL for seed.
+ *
+ * Returns 0 on success.
+ * Returns non-zero if the input data is invalid or the pool is not enabled.
+ */
+extern int tabby_server_pool_fill(tabby_server *S, const void *seed, int seed_bytes);
+
+/*
+ * Rotate to the next pre-generated ephemeral key
+ *
+ * Like tabby_server_rekey(), the new key is used as soon as this function
+ * returns.  Unlike it, this does not wait to erase the old ephemeral secret:
+ * the rekey thread erases it after the grace period, or else the next rekey
+ * or rotation does.  If the last eight keys were all published within the
+ * grace period, this waits for the oldest to be out of use.  It is safe to
+ * call this while other threads are processing handshakes.  If another
+ * rekey is in progress, this returns 0 without doing anything.
+ *
+ * Returns 0 on success.
+ * Returns non-zero if the input data is invalid or the pool is empty.
+ */
+extern int tabby_server_rotate(tabby_server *S);
+
+/*
+ * Disable the ephemeral key pool and free its memory
+ *
+ * The unused ephemeral secrets are securely erased.  This function is not
+ * thread-safe: call it after stopping workers and the rekey thread.
+ *
+ * Returns 0 on success.
+ * Returns non-zero if the input data is invalid.
+ */
+extern int tabby_server_pool_free(tabby_server *S);
+
+/*
+ * Calculate a cookie for a client request
+ *
+ * When the server is under load, it can reply to a client request with a
+ * cookie instead of calling the handshake functions, which is much cheaper.
+ * The client then sends the same request again along with the cookie, and the
+ * server checks it with tabby_server_cookie_check() before doing the
+ * handshake.  This ensures that the client can receive packets at its source
+ * address, so spoofed floods cannot make the server do expensive math.
+ *
+ * The address can be any bytes that identify where the request came from,
+ * such as the source IP address and port.  The cookie is 16 bytes.
+ *
+ * Cookies stay valid until the server has been rekeyed twice, by calling
+ * tabby_server_rekey() or by the rekey thread.  Rotating to pooled keys with
+ * tabby_server_rotate() or by handshake count does not expire cookies, so
+ * they last at least one rekey interval even under a flood.  The server
+ * does not store anything about issued cookies.  It is safe to call this from
+ * several threads at once.
+ *
+ * Returns 0 on success.
+ * Returns non-zero if the input data is invalid.
+ */
+extern int tabby_server_cookie(tabby_server *S, const void *address, int address_bytes, const char client_request[96], char cookie[16]);
+
+/*
+ * Check a cookie returned by a client
+ *
+ * The address and request must be the same as when the cookie was made.
+ * It is safe to call this from several threads at once.
+ *
+ * Returns 0 if the cookie is valid.
+ * Returns non-zero if the cookie is invalid or expired.
+ */
+extern int tabby_server_cookie_check(tabby_server *S, const void *address, int address_bytes, const char client_request[96], const char cookie[16]);
+
+
+//// Server workers
+
+/*
+ * Workers allow several threads to process client requests for the same
+ * server at once, without locks.  The server keys are shared, and each
+ * worker has its own random number generator for handshake nonces.
+ *
+ * Example:
+ *
+ * 	// On the main thread, after tabby_server_gen():
+ * 	for (int ii = 0; ii < thread_count; ++ii) {
+ * 		assert(0 == tabby_worker_gen(&workers[ii], &s, 0, 0));
+ * 	}
+ *
+ * 	// Then each thread uses only its own worker:
+ * 	tabby_worker_handshake(&workers[thread_index], request, response, key);
+ *
+ * The tabby_server object must outlive its workers.  Workers use the new
+ * ephemeral key as soon as tabby_server_rekey() publishes it, so rekeying can
+ * run alongside them.  tabby_server_handshake() uses the server generator, so
+ * it should only be called from one thread at a time.
+ */
+
+// Opaque worker state object
+typedef struct {
+	char internal[96];
+} tabby_worker;
+
+/*
+ * Generate a Tabby worker object for a server
+ *
+ * The worker random number generator is derived from the server generator,
+ * so this does not block waiting for entropy.  This function is not
+ * thread-safe: create the workers before starting the threads that use them.
+ *
+ * You may optionally provide extra random number data as a seed to improve
+ * the quality of the generated nonces; otherwise pass NULL for seed.
+ *
+ * Returns 0 on success.
+ * Returns non-zero if the input data is invalid.
+ */
+extern int tabby_worker_gen(tabby_worker *W, tabby_server *S, const void *seed, int seed_bytes);
+
+/*
+ * Process client request on a worker
+ *
+ * Same as tabby_server_handshake(), except that it is safe to call this
+ * from several threads at once as long as each uses a different worker.
+ *
+ * Returns 0 on success.
+ * Returns non-zero if the input data is invalid.
+ */
+extern int tabby_worker_handshake(tabby_worker *W, const char client_request[96], char server_response[128], char secret_key[32]);
+
+/*
+ * Process a batch of client requests on a worker
+ *
+ * Same as tabby_server_handshake_batch(), except that it is safe to call this
+ * from several threads at once as long as each uses a different worker.
+ *
+ * Returns 0 if all of the handshakes succeeded.
+ * Returns non-zero if any of the input data is invalid.
+ */
+extern int tabby_worker_handshake_batch(tabby_worker *W, int count, const char *client_requests, char *server_responses, char *secret_keys, int *results);
+
+
+//// Session resumption
+
+/*
+ * After a handshake, the server can issue a resumption ticket to the client.
+ * To reconnect later, the client sends the ticket back and both sides derive
+ * a new secret key without any public key math:
+ *
+ * 	Server: tabby_server_ticket(&s, server_secret_key, ticket)
+ * 	-> Send ticket to client over the secure session
+ *
+ * 	Client: tabby_client_resume(&c, ticket, resume_request)
+ * 	-> Send resume request to server
+ *
+ * 	Server: tabby_server_resume(&s, resume_request, server_response, new_key)
+ * 	-> Send server response to client
+ *
+ * 	Client: tabby_client_resume_handshake(&c, client_secret_key, server_response, new_key)
+ *
+ * Tickets are encrypted and authenticated with a server key that changes at
+ * each rekey, and they are accepted until the server has been rekeyed twice.
+ * A resumed session does not have forward secrecy until the ticket key is
+ * rotated out, and the client should delete the ticket after using it.  The
+ * server can issue a new ticket for the resumed session key.
+ */
+
+/*
+ * Issue a resumption ticket for a session
+ *
+ * The secret key is the one produced by the server handshake.  The ticket is
+ * 48 bytes and should be sent to the client over the secure session.
+ *
+ * It is safe to call this from several threads at once.
+ *
+ * Returns 0 on success.
+ * Returns non-zero if the input data is invalid.
+ */
+extern int tabby_server_ticket(tabby_server *S, const char secret_key[32], char ticket[48]);
+
+/*
+ * Process client resume request
+ *
+ * Opens the ticket and derives a new secret key for the resumed session.
+ * The server response is 64 bytes and should be delivered to the client.
+ *
+ * Returns 0 on success.
+ * Returns non-zero if the ticket is invalid or expired.
+ */
+extern int tabby_server_resume(tabby_server *S, const char resume_request[80], char server_response[64], char secret_key[32]);
+
+/*
+ * Process client resume request on a worker
+ *
+ * Same as tabby_server_resume(), except that it is safe to call this from
+ * several threads at once as long as each uses a different worker.
+ *
+ * Returns 0 on success.
+ * Returns non-zero if the ticket is invalid or expired.
+ */
+extern int tabby_worker_resume(tabby_worker *W, const char resume_request[80], char server_response[64], char secret_key[32]);
+
+/*
+ * Generate a resume request from a ticket
+ *
+ * The client object must have been generated with tabby_client_gen().  This
+ * replaces the client nonce, so finish any handshake in progress first.
+ *
+ * Returns 0 on success.
+ * Returns non-zero if the input data is invalid.
+ */
+extern int tabby_client_resume(tabby_client *C, const char ticket[48], char resume_request[80]);
+
+/*
+ * Process server resume response
+ *
+ * The old secret key is the one from the session that the ticket was issued
+ * for.  A new secret key is derived that will match the one on the server.
+ *
+ * Returns 0 on success.
+ * Returns non-zero if the input data is invalid.
+ */
+extern int tabby_client_resume_handshake(tabby_client *C, const char old_secret_key[32], const char server_response[64], char secret_key[32]);
+
+
+//// Multi-identity host
+
+/*
+ * A host answers handshakes for many server identities, each with its own
+ * long-term key pair.  The identities share one tabby_server object, which
+ * provides the random number generator, ephemeral keys, rekey thread, replay
+ * cache, cookies, tickets, and workers.  The server's own key is key id 0.
+ *
+ * The client must tell the server which identity it wants, for example by
+ * sending the key id or the key hint with its request.  The key hint is the
+ * first 8 bytes of the server public key.
+ *
+ * Example:
+ *
+ * 	assert(0 == tabby_host_gen(&h, &s, 64));
+ * 	for (each saved identity) {
+ * 		int key_id = tabby_host_add(&h, server_data);
+ * 	}
+ *
+ * 	// On request:
+ * 	int key_id = tabby_host_find(&h, key_hint);
+ * 	tabby_host_worker_handshake(&h, &w, key_id, request, response, key);
+ *
+ * 	// On shutdown:
+ * 	tabby_host_free(&h);
+ */
+
+// Opaque host state object
+typedef struct {
+	char internal[64];
+} tabby_host;
+
+/*
+ * Generate a Tabby host object for a server
+ *
+ * Capacity is the maximum number of identities, including the server's own.
+ * The tabby_server object must outlive the host.
+ *
+ * Returns 0 on success.
+ * Returns non-zero if the input data is invalid or out of memory.
+ */
+extern int tabby_host_gen(tabby_host *H, tabby_server *S, int capacity);
+
+/*
+ * Add an identity to the host
+ *
+ * The server data is the 64 bytes saved by tabby_server_save_secret().
+ * This function is not thread-safe: add identities before handshakes start.
+ *
+ * Returns the key id for the new identity on success.
+ * Returns -1 if the input data is invalid, the host is full, or the key hint
+ * is the same as an identity that was already added.
+ */
+extern int tabby_host_add(tabby_host *H, const char server_data[64]);
+
+/*
+ * Find an identity by key hint
+ *
+ * Returns the key id on success.
+ * Returns -1 if no identity has this key hint.
+ */
+extern int tabby_host_find(tabby_host *H, const char key_hint[8]);
+
+/*
+ * Returns the public key for a host identity
+ *
+ * Returns 0 on success.
+ * Returns non-zero if the input data is invalid.
+ */
+extern int tabby_host_get_public_key(tabby_host *H, int key_id, char public_key[64]);
+
+/*
+ * Process client request for a host identity
+ *
+ * Same as tabby_server_handshake(), using the long-term key of the identity.
+ * This uses the server generator, so it should be called from one thread.
+ *
+ * Returns 0 on success.
+ * Returns non-zero if the input data is invalid.
+ */
+extern int tabby_host_handshake(tabby_host *H, int key_id, const char client_request[96], char server_response[128], char secret_key[32]);
+
+/*
+ * Process client request for a host identity on a worker
+ *
+ * The worker must have been generated for the host's server.  It is safe to
+ * call this from several threads at once as long as each uses a different
+ * worker.
+ *
+ * Returns 0 on success.
+ * Returns non-zero if the input data is invalid.
+ */
+extern int tabby_host_worker_handshake(tabby_host *H, tabby_worker *W, int key_id, const char client_request[96], char server_response[128], char secret_key[32]);
+
+/*
+ * Erase the host identities and free the host memory
+ */
+extern void tabby_host_free(tabby_host *H);
+
 
 //// Signatures
 
@@ -187,6 +755,78 @@ extern int tabby_server_handshake(tabby_server *S, const char client_request[96]
  */
 extern int tabby_sign(tabby_server *S, const void *message, int bytes, char signature[96]);
 
+// One piece of a message for tabby_signv() and tabby_verifyv()
+typedef struct {
+	const void *data;
+	int bytes;
+} tabby_iovec;
+
+/*
+ * Sign a message that is split into pieces
+ *
+ * The pieces are hashed in order straight from the caller's buffers, and
+ * the signature is one that tabby_sign() could make for the pieces joined
+ * together, so either verify function may check it.  Like tabby_sign(), it
+ * uses a pooled random nonce while the nonce pool is running.  Pieces may be
+ * empty, but the whole message must not be.
+ *
+ * Returns 0 on success.
+ * Returns non-zero if the input data is invalid.
+ */
+extern int tabby_signv(tabby_server *S, const tabby_iovec *message, int pieces, char signature[96]);
+
+/*
+ * Sign a batch of messages
+ *
+ * This always uses the default deterministic nonces, even while the nonce
+ * pool is running, so it produces the same signatures as tabby_sign() does
+ * without the pool.  It is faster than signing one at a time because the
+ * points are converted to affine coordinates together, sharing one field
+ * inversion.  The signatures are checked with tabby_verify().
+ *
+ * The arrays have count entries each.  If results is not NULL, then it
+ * should have room for count integers, and each is set to 0 if the
+ * corresponding message was signed or non-zero if it was not.
+ *
+ * Returns 0 if all of the messages were signed.
+ * Returns non-zero if any of the messages could not be signed or the input
+ * data is invalid.
+ */
+extern int tabby_sign_batch(tabby_server *S, int count, const void *const messages[], const int bytes[], char *const signatures[], int results[]);
+
+/*
+ * Start precomputing signature nonces in a background thread
+ *
+ * By default signatures use a nonce derived from the message, so the same
+ * message always has the same signature, and tabby_sign() has to do an EC
+ * multiplication.  While the nonce pool is running, signatures use random
+ * nonces that the thread computes ahead of time, so signing only needs to
+ * hash.  If the pool runs dry, signing falls back to the default nonce.
+ * Either way the signatures are checked with tabby_verify().
+ *
+ * The count is rounded up to a power of two, up to 65536.  The pool is
+ * filled before this returns.
+ *
+ * The pool must be stopped with tabby_server_nonce_pool_stop() before the
+ * server object is erased or goes out of scope.
+ *
+ * Returns 0 on success.
+ * Returns non-zero if the input data is invalid, the pool is running, or
+ * out of memory.
+ */
+extern int tabby_server_nonce_pool_start(tabby_server *S, int count);
+
+/*
+ * Stop the nonce pool thread, erase the unused nonces and free the pool
+ *
+ * This function is not thread-safe: call it when no other thread is
+ * signing.  It is safe to call this if the pool was never started.
+ *
+ * Returns 0 on success.
+ * Returns non-zero if the input data is invalid.
+ */
+extern int tabby_server_nonce_pool_stop(tabby_server *S);
+
 /*
  * Verify a message signed using EdDSA
  *
@@ -195,6 +835,369 @@ extern int tabby_sign(tabby_server *S, const void *message, int bytes, char sign
  */
 extern int tabby_verify(const void *message, int bytes, const char public_key[64], const char signature[96]);
 
+/*
+ * Verify a message that is split into pieces, as in tabby_signv()
+ *
+ * Returns 0 on success.
+ * Returns non-zero if the signature or input data is invalid.
+ */
+extern int tabby_verifyv(const tabby_iovec *message, int pieces, const char public_key[64], const char signature[96]);
+
+// Opaque signature verification context object
+typedef struct {
+	char internal[96];
+} tabby_verify_ctx;
+
+/*
+ * Precompute a public key for verifying many signatures
+ *
+ * This validates the public key once and builds 48 KB of tables for it, so
+ * that tabby_verify_with_ctx() is about twice as fast as tabby_verify().
+ * It is worthwhile for keys that verify more than a handful of signatures.
+ *
+ * The context is read-only after this returns, so it may be shared between
+ * threads.  The object must be freed with tabby_verify_ctx_free().
+ *
+ * Returns 0 on success.
+ * Returns non-zero if the public key is invalid or out of memory.
+ */
+extern int tabby_verify_ctx_gen(tabby_verify_ctx *V, const char public_key[64]);
+
+/*
+ * Verify a message signed using EdDSA with a precomputed public key
+ *
+ * Returns 0 on success.
+ * Returns non-zero if the signature or input data is invalid.
+ */
+extern int tabby_verify_with_ctx(const tabby_verify_ctx *V, const void *message, int bytes, const char signature[96]);
+
+/*
+ * Free a signature verification context
+ */
+extern void tabby_verify_ctx_free(tabby_verify_ctx *V);
+
+// Opaque verified signature cache object
+typedef struct {
+	char internal[64];
+} tabby_verify_cache;
+
+/*
+ * Create a cache of verified signatures
+ *
+ * This is useful when the same signed messages, like bearer tokens, are
+ * verified over and over.  It holds up to capacity signatures, rounded up to
+ * a power of two, and evicts the least recently used ones from each part of
+ * the table as it fills.  Each entry uses about 20 bytes.
+ *
+ * Returns 0 on success.
+ * Returns non-zero if the input data is invalid or out of memory.
+ */
+extern int tabby_verify_cache_gen(tabby_verify_cache *V, int capacity);
+
+/*
+ * Verify a signed message, skipping the math if it was verified before
+ *
+ * This works like tabby_verify().  Only valid signatures are remembered.
+ * It is safe to call this from several threads at once on the same cache,
+ * and a thread never waits for another to finish with the cache.
+ *
+ * Returns 0 if the signature is valid.
+ * Returns non-zero if the signature or input data is invalid.
+ */
+extern int tabby_verify_cached(tabby_verify_cache *V, const void *message, int bytes, const char public_key[64], const char signature[96]);
+
+/*
+ * Free the memory used by the cache
+ */
+extern void tabby_verify_cache_free(tabby_verify_cache *V);
+
+/*
+ * Enable the cache of precomputed public keys used by tabby_verify()
+ *
+ * When many signers share a verifier, most signatures tend to come from a
+ * few of them.  With the cache enabled, tabby_verify() and the other
+ * verification functions build the same tables as tabby_verify_ctx_gen() for
+ * public keys that are seen more than once, keep them for the most recently
+ * used keys, and verify with them in about 30% less time.  Keys that are
+ * only seen once do not get tables.  Building the tables takes about as
+ * long as five verifications, so the cache only pays off if it has room
+ * for the keys that are used over and over.
+ *
+ * The cache uses at most max_bytes of memory, at about 49 KB per public key.
+ * It is safe to verify from several threads at once with the cache enabled,
+ * but it must not be enabled or disabled while any thread is verifying.
+ *
+ * Returns 0 on success.
+ * Returns non-zero if it is already enabled, max_bytes is too small for
+ * one public key, or out of memory.
+ */
+extern int tabby_verify_key_cache_enable(unsigned long long max_bytes);
+
+/*
+ * Count the lookups that found tables in the public key cache, and the
+ * tables it has built, since it was enabled
+ *
+ * Many builds for few hits means that the cache is too small for the keys
+ * in use.  The counts are approximate while other threads are verifying.
+ *
+ * Returns 0 on success.
+ * Returns non-zero if the input data is invalid or the cache is disabled.
+ */
+extern int tabby_verify_key_cache_stats(unsigned long long *hits, unsigned long long *builds);
+
+/*
+ * Disable the public key cache and free its memory
+ */
+extern void tabby_verify_key_cache_disable();
+
+// Opaque streaming signature object
+typedef struct {
+	char internal[512];
+} tabby_stream;
+
+/*
+ * Start signing a message in prehash mode
+ *
+ * Prehash mode reads the message only once, in pieces of any size, so a
+ * message does not need to fit in memory.  Feed it in with
+ * tabby_stream_update() and then call tabby_sign_final().  The server object
+ * must stay valid until then.
+ *
+ * Prehash signatures are checked with tabby_verify_init(), and are not
+ * compatible with tabby_sign() and tabby_verify().
+ *
+ * Returns 0 on success.
+ * Returns non-zero if the input data is invalid.
+ */
+extern int tabby_sign_init(tabby_stream *T, tabby_server *S);
+
+/*
+ * Start verifying a message signed in prehash mode
+ *
+ * Feed the message in with tabby_stream_update() and then call
+ * tabby_verify_final().
+ *
+ * Returns 0 on success.
+ * Returns non-zero if the input data is invalid.
+ */
+extern int tabby_verify_init(tabby_stream *T, const char public_key[64]);
+
+/*
+ * Add the next piece of the message to a stream
+ *
+ * Returns 0 on success.
+ * Returns non-zero if the input data is invalid.
+ */
+extern int tabby_stream_update(tabby_stream *T, const void *data, unsigned long long bytes);
+
+/*
+ * Finish signing a message in prehash mode
+ *
+ * The stream is erased and must be initialized again before reuse.
+ *
+ * Returns 0 on success.
+ * Returns non-zero if the input data is invalid.
+ */
+extern int tabby_sign_final(tabby_stream *T, char signature[96]);
+
+/*
+ * Finish verifying a message signed in prehash mode
+ *
+ * The stream is erased and must be initialized again before reuse.
+ *
+ * Returns 0 if the signature is valid.
+ * Returns non-zero if the signature or input data is invalid.
+ */
+extern int tabby_verify_final(tabby_stream *T, const char signature[96]);
+
+/*
+ * Sign a file
+ *
+ * The file is mapped into memory and hashed in parallel on all cores, so it
+ * is much faster than tabby_sign() for large files and does not need to fit
+ * in memory.  Check the signature with tabby_verify_file().
+ *
+ * Returns 0 on success.
+ * Returns non-zero if the file cannot be read or the input data is invalid.
+ */
+extern int tabby_sign_file(tabby_server *S, const char *path, char signature[96]);
+
+/*
+ * Verify the signature of a file from tabby_sign_file()
+ *
+ * Returns 0 if the signature is valid.
+ * Returns non-zero if the signature is invalid, the file cannot be read,
+ * or the input data is invalid.
+ */
+extern int tabby_verify_file(const char *path, const char public_key[64], const char signature[96]);
+
+// Opaque signed log writer object
+typedef struct {
+	char internal[640];
+} tabby_log;
+
+/*
+ * Open a signed log for appending, creating it if it does not exist
+ *
+ * A log is a file of length-prefixed records with signed checkpoints mixed
+ * in.  Each checkpoint signs a BLAKE2 hash chained from the one before it,
+ * covering the records in between, so records cannot be changed, removed,
+ * or reordered without breaking the chain.  A checkpoint is written once
+ * checkpoint_bytes of records have been appended since the last one, or
+ * 1 MB if checkpoint_bytes is 0.  An existing log is scanned to pick up the
+ * chain where it left off.  If its last entry was cut off by a crash or a
+ * failed write, the file is truncated back to the end of the last whole
+ * entry before appending.
+ *
+ * The server object must stay valid until the log is closed.  A log object
+ * must only be used by one thread at a time.
+ *
+ * Returns 0 on success.
+ * Returns non-zero if the file cannot be opened or truncated, an existing
+ * log is malformed, or the input data is invalid.
+ */
+extern int tabby_log_open(tabby_log *L, tabby_server *S, const char *path, int checkpoint_bytes);
+
+/*
+ * Append a record to a signed log
+ *
+ * Records are buffered, and are written out and signed at each checkpoint.
+ *
+ * If a write or signature fails, the log may end with a partial record, so
+ * every later append and checkpoint fails too.  Close the log and open it
+ * again to drop the partial record and carry on, or use tabby_log_verify()
+ * to find out how much of it was signed.
+ *
+ * Returns 0 on success.
+ * Returns non-zero if the write failed, an earlier one failed, or the input
+ * data is invalid.
+ */
+extern int tabby_log_append(tabby_log *L, const void *data, int bytes);
+
+/*
+ * Write a checkpoint that signs the records appended since the last one
+ *
+ * Returns 0 on success, or if there is nothing to sign.
+ * Returns non-zero if the write failed, an earlier one failed, or the input
+ * data is invalid.
+ */
+extern int tabby_log_checkpoint(tabby_log *L);
+
+/*
+ * Write a final checkpoint and close a signed log
+ *
+ * The log object is erased and must be opened again before reuse.
+ *
+ * Returns 0 on success.
+ * Returns non-zero if the write failed or the input data is invalid.
+ */
+extern int tabby_log_close(tabby_log *L);
+
+/*
+ * Verify a signed log
+ *
+ * The file is mapped into memory and the segments between checkpoints are
+ * hashed and their signatures checked in parallel on all cores.  Records
+ * after the last checkpoint are not signed, so if signed_bytes is not 0 it
+ * is set to the number of bytes at the start of the file that are covered by
+ * checkpoints.
+ *
+ * Returns 0 if the log is well formed and every checkpoint is valid.
+ * Returns non-zero if any checkpoint is invalid, the log is malformed or
+ * cannot be read, or the input data is invalid.
+ */
+extern int tabby_log_verify(const char *path, const char public_key[64], unsigned long long *signed_bytes);
+
+/*
+ * Get the size of the largest Merkle inclusion proof for a batch of count
+ * messages, which is 8 + 32 * ceil(log2(count)) bytes
+ *
+ * Returns the number of bytes on success.
+ * Returns -1 if count is invalid.
+ */
+extern int tabby_merkle_proof_bytes(int count);
+
+/*
+ * Get the size of the Merkle inclusion proof for message index in a batch of
+ * count messages, which is the size tabby_merkle_root() expects
+ *
+ * Returns the number of bytes on success.
+ * Returns -1 if count or index is invalid.
+ */
+extern int tabby_merkle_proof_bytes_at(int count, int index);
+
+/*
+ * Sign a batch of messages with one signature over a Merkle tree
+ *
+ * This hashes the messages into a Merkle tree and signs only the root, so it
+ * costs one signature for any number of messages.  Every message shares the
+ * one signature, and each gets its own inclusion proof.  Up to 2^24
+ * messages can be signed at once.
+ *
+ * Each proofs[i] should have room for tabby_merkle_proof_bytes(count) bytes.
+ * Proofs for some messages are shorter; the actual size is given by
+ * tabby_merkle_proof_bytes_at(count, i).
+ *
+ * Returns 0 on success.
+ * Returns non-zero if the input data is invalid.
+ */
+extern int tabby_merkle_sign(tabby_server *S, int count, const void *const messages[], const int bytes[], char signature[96], char *const proofs[]);
+
+/*
+ * Compute the signed root of a Merkle batch from one message and its proof
+ *
+ * This only hashes, so it is fast.  All of the messages in a batch lead to
+ * the same root, so a verifier can check the root signature once with
+ * tabby_merkle_verify_root() and then check each of the other messages by
+ * comparing its root to the verified one.
+ *
+ * proof_bytes must be the actual size of the proof, from
+ * tabby_merkle_proof_bytes_at().  Proofs with trailing bytes are rejected.
+ *
+ * Returns 0 on success.
+ * Returns non-zero if the proof or input data is invalid.
+ */
+extern int tabby_merkle_root(const void *message, int bytes, const char *proof, int proof_bytes, char root[64]);
+
+/*
+ * Verify the signature of a Merkle batch root from tabby_merkle_root()
+ *
+ * Returns 0 if the signature is valid.
+ * Returns non-zero if the signature or input data is invalid.
+ */
+extern int tabby_merkle_verify_root(const char root[64], const char public_key[64], const char signature[96]);
+
+/*
+ * Verify one message from a Merkle batch
+ *
+ * This is tabby_merkle_root() followed by tabby_merkle_verify_root().
+ *
+ * Returns 0 if the message and signature are valid.
+ * Returns non-zero if the message, proof, signature or input data is invalid.
+ */
+extern int tabby_merkle_verify(const void *message, int bytes, const char *proof, int proof_bytes, const char public_key[64], const char signature[96]);
+
+/*
+ * Verify a batch of signed messages
+ *
+ * This checks a random linear combination of the signatures with a single
+ * multi-scalar multiplication, which is faster than calling tabby_verify()
+ * on each of them.  If that check fails, the signatures are verified one at
+ * a time to find the bad ones.  Each entry may use a different public key.
+ *
+ * The arrays have count entries each.  If results is not NULL, then it
+ * should have room for count integers, and each is set to 0 if the
+ * corresponding signature is valid or non-zero if it is not.
+ *
+ * The batch check ignores points of small order, so unlike tabby_verify()
+ * it accepts a valid signature whose R has had such a point added to it.
+ * This cannot be used to sign a new message.
+ *
+ * Returns 0 if all of the signatures are valid.
+ * Returns non-zero if any of the signatures or input data is invalid.
+ */
+extern int tabby_verify_batch(int count, const void *const messages[], const int bytes[], const char *const public_keys[], const char *const signatures[], int results[]);
+
 
 //// Passwords
 
@@ -30,11 +30,30 @@
 #include "snowshoe.h"
 #include "cymric.h"
 #include "blake2.h"
+#include "chacha.h"
 
 #include "Platform.hpp"
+#include "Atomic.hpp"
 #include "SecureErase.hpp"
+#include "SecureEqual.hpp"
 using namespace cat;
 
+#include <stdlib.h>
+#include <stdio.h>
+
+#if defined(CAT_OS_WINDOWS)
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <sys/time.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
 static bool m_initialized = false;
 
 // Valid flag values
@@ -102,9 +121,89 @@ static int generate_key(cymric_rng *rng, char private_key[32], char public_key[6
 	return 0;
 }
 
+// Largest number of key pairs for generate_key_batch()
+static const int GENERATE_BATCH_MAX = 32;
+
+// Generate up to GENERATE_BATCH_MAX key pairs at once, sharing one inversion
+static int generate_key_batch(cymric_rng *rng, int count, char *const private_keys[], char *const public_keys[]) {
+	int results[GENERATE_BATCH_MAX];
+
+	for (int ii = 0; ii < count; ++ii) {
+		// Reuse public key buffer for 64 bytes of private key material,
+		// and reduce it the same way as generate_key()
+		if (cymric_random(rng, public_keys[ii], 64)) {
+			return -1;
+		}
+		snowshoe_mod_q(public_keys[ii], private_keys[ii]);
+	}
+
+	// If any of the private keys were zero,
+	if (snowshoe_mul_gen_batch(count, private_keys, public_keys, 0, results)) {
+		for (int ii = 0; ii < count; ++ii) {
+			// Generate a replacement for just that key pair
+			if (results[ii] != 0 && generate_key(rng, private_keys[ii], public_keys[ii])) {
+				return -1;
+			}
+		}
+	}
+
+	return 0;
+}
+
+// Compute the BLAKE2b chaining value after the padded key block, so that
+// a MAC resumed from it with blake2b_resume_key() skips that compression.
+// The digest length is part of the parameter block, so it must match the
+// one passed to blake2b_final().
+static int blake2b_key_block(u64 h[8], int outlen, const char *key, int keylen) {
+	static const u8 PAD[BLAKE2B_BLOCKBYTES + 1] = { 0 };
+	blake2b_state B;
+
+	// BLAKE2 keeps two blocks buffered, so it only compresses the key
+	// block once one byte more than a block of padding has been added
+	if (blake2b_init_key(&B, outlen, key, keylen) ||
+		blake2b_update(&B, PAD, sizeof(PAD))) {
+		CAT_SECURE_OBJCLR(B);
+		return -1;
+	}
+
+	int result = -1;
+
+	// If exactly the key block was compressed,
+	if (B.t[0] == BLAKE2B_BLOCKBYTES && B.t[1] == 0 && B.buflen == sizeof(PAD)) {
+		memcpy(h, B.h, sizeof(B.h));
+		result = 0;
+	}
+
+	CAT_SECURE_OBJCLR(B);
+
+	return result;
+}
+
+// Set up B as if blake2b_init_key() had been called and its key block had
+// been compressed.  At least one byte must be hashed before blake2b_final().
+static void blake2b_resume_key(blake2b_state *B, const u64 h[8]) {
+	memset(B, 0, sizeof(blake2b_state));
+	memcpy(B->h, h, sizeof(B->h));
+	B->t[0] = BLAKE2B_BLOCKBYTES;
+}
+
+#include "replay.inc"
 #include "server.inc"
+#include "pool.inc"
+#include "rekey.inc"
+#include "cookie.inc"
+#include "host.inc"
 #include "client.inc"
+#include "clientpool.inc"
+#include "ticket.inc"
+#include "nonce.inc"
+#include "keycache.inc"
 #include "sign.inc"
+#include "prehash.inc"
+#include "file.inc"
+#include "log.inc"
+#include "verifycache.inc"
+#include "merkle.inc"
 #include "passwords.inc"
 
 #ifdef __cplusplus
@@ -129,6 +228,54 @@ int _tabby_init(int expected_version) {
 		return -1;
 	}
 
+	// If the internal version of the worker structure is bigger
+	// than the one that the user sees,
+	if (sizeof(worker_internal) > sizeof(tabby_worker)) {
+		return -1;
+	}
+
+	// If the internal version of the host structure is bigger
+	// than the one that the user sees,
+	if (sizeof(host_internal) > sizeof(tabby_host)) {
+		return -1;
+	}
+
+	// If the internal version of the server key structure is bigger
+	// than the one that the user sees,
+	if (sizeof(server_key_internal) > sizeof(tabby_server_key)) {
+		return -1;
+	}
+
+	// If the internal version of the client pool structure is bigger
+	// than the one that the user sees,
+	if (sizeof(client_pool_internal) > sizeof(tabby_client_pool)) {
+		return -1;
+	}
+
+	// If the internal version of the verify context structure is bigger
+	// than the one that the user sees,
+	if (sizeof(verify_ctx_internal) > sizeof(tabby_verify_ctx)) {
+		return -1;
+	}
+
+	// If the internal version of the stream structure is bigger
+	// than the one that the user sees,
+	if (sizeof(stream_internal) > sizeof(tabby_stream)) {
+		return -1;
+	}
+
+	// If the internal version of the verify cache structure is bigger
+	// than the one that the user sees,
+	if (sizeof(verify_cache_internal) > sizeof(tabby_verify_cache)) {
+		return -1;
+	}
+
+	// If the internal version of the log structure is bigger
+	// than the one that the user sees,
+	if (sizeof(log_internal) > sizeof(tabby_log)) {
+		return -1;
+	}
+
 	// If Cymric cannot initialize,
 	if (cymric_init()) {
 		return -1;
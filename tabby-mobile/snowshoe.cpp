@@ -44,11 +44,10 @@
 
 #include "ecmul.inc"
 #include "snowshoe.h"
+#include "SecureErase.hpp"
 
 #ifndef CAT_ENDIAN_LITTLE
 
-#include "SecureErase.hpp"
-
 /*
  * This file is optimized for little-endian architectures.  In this
  * case the input bytes are already in the internal data format, so
@@ -100,6 +99,9 @@ static bool invalid_key(const u64 k[4]) {
 	return false;
 }
 
+// Number of entries that share a field inversion in the batch functions
+static const int BATCH_MAX = 32;
+
 
 //// Simple Self-Test
 
@@ -115,6 +117,16 @@ static const ufp CN1 = {
 	{0xfffffffffffffffeULL, 0x7fffffffffffffffULL}
 };
 
+// p itself, which is a partially reduced form of zero
+static const ufp CP = {
+	{0xffffffffffffffffULL, 0x7fffffffffffffffULL}
+};
+
+// fp_inv_vartime() must match fp_inv() on these inputs
+static const ufp *const INV_TEST_INPUTS[4] = {
+	&CX3, &C1, &CN1, &CP
+};
+
 static bool fp_ops_test() {
 	ufp a0, a1, a2;
 
@@ -144,6 +156,20 @@ static bool fp_ops_test() {
 		return false;
 	}
 
+	// inv_vartime, inv, reduce, isequal
+
+	for (int ii = 0; ii < 4; ++ii) {
+		fp_inv(*INV_TEST_INPUTS[ii], a1);
+		fp_complete_reduce(a1);
+
+		fp_inv_vartime(*INV_TEST_INPUTS[ii], a2);
+		fp_complete_reduce(a2);
+
+		if (!fp_isequal_ct(a1, a2)) {
+			return false;
+		}
+	}
+
 	// add, reduce, iszero
 
 	fp_set(CN1, a0);
@@ -288,6 +314,9 @@ int _snowshoe_init(int expected_version) {
 		return -1;
 	}
 
+	// Build the generator table for variable-time verification
+	ec_gen_table_wnaf_init();
+
 	if (!self_test()) {
 		return -1;
 	}
@@ -476,7 +505,7 @@ int snowshoe_mul(const char k_raw[32], const char P[64], char R[64]) {
 	ec_load_xy((const u8*)P, p1);
 
 	// Validate point
-	if (!ec_valid(p1)) {
+	if (!ec_valid_vartime(p1)) {
 		return -1;
 	}
 
@@ -509,6 +538,140 @@ int snowshoe_mul(const char k_raw[32], const char P[64], char R[64]) {
 	return 0;
 }
 
+int snowshoe_mul_batch(int count, const char *const k[], const char *const P[], char *const R[], int results[]) {
+	ecpt X[BATCH_MAX];
+	ecpt_affine r[BATCH_MAX];
+	ufe scratch[BATCH_MAX];
+	int index[BATCH_MAX];
+	int failures = 0;
+
+	for (int offset = 0; offset < count; offset += BATCH_MAX) {
+		int n = 0;
+
+		for (int ii = offset; ii < count && ii < offset + BATCH_MAX; ++ii) {
+#ifndef CAT_ENDIAN_LITTLE
+			u64 key[4];
+			ec_load_k(k[ii], key);
+
+			// Load point
+			ecpt_affine p;
+			ec_load_xy((const u8*)P[ii], p);
+#else
+			const u64 *key = (const u64 *)k[ii];
+			const ecpt_affine &p = *(const ecpt_affine *)P[ii];
+#endif // CAT_ENDIAN_LITTLE
+
+			// Validate key and point
+			if (invalid_key(key) || !ec_valid_vartime(p)) {
+				results[ii] = -1;
+				++failures;
+				continue;
+			}
+
+			// X = 4kP, left in extended coordinates
+			ec_mul_affine_ext(key, p, X[n]);
+
+#ifndef CAT_ENDIAN_LITTLE
+			CAT_SECURE_OBJCLR(key);
+#endif // CAT_ENDIAN_LITTLE
+
+			index[n++] = ii;
+			results[ii] = 0;
+		}
+
+		// If there is nothing to convert,
+		if (n <= 0) {
+			continue;
+		}
+
+		// Compute affine coordinates with one shared inversion
+		ec_affine_batch(X, r, scratch, n);
+
+		for (int jj = 0; jj < n; ++jj) {
+#ifndef CAT_ENDIAN_LITTLE
+			// Save result endian-neutral
+			ec_save_xy(r[jj], (u8*)R[index[jj]]);
+#else
+			// Copy out with memcpy() since R[] may not be 16-byte aligned
+			memcpy(R[index[jj]], &r[jj], sizeof(ecpt_affine));
+#endif // CAT_ENDIAN_LITTLE
+		}
+	}
+
+	CAT_SECURE_OBJCLR(X);
+	CAT_SECURE_OBJCLR(r);
+	CAT_SECURE_OBJCLR(scratch);
+
+	return failures > 0 ? -1 : 0;
+}
+
+int snowshoe_mul_gen_batch(int count, const char *const k[], char *const R[], char mul4, int results[]) {
+	ecpt X[BATCH_MAX];
+	ecpt_affine r[BATCH_MAX];
+	ufe scratch[BATCH_MAX];
+	int index[BATCH_MAX];
+	int failures = 0;
+
+	for (int offset = 0; offset < count; offset += BATCH_MAX) {
+		int n = 0;
+
+		for (int ii = offset; ii < count && ii < offset + BATCH_MAX; ++ii) {
+#ifndef CAT_ENDIAN_LITTLE
+			u64 key[4];
+			ec_load_k(k[ii], key);
+#else
+			const u64 *key = (const u64 *)k[ii];
+#endif // CAT_ENDIAN_LITTLE
+
+			// Validate key
+			if (invalid_key(key)) {
+				results[ii] = -1;
+				++failures;
+				continue;
+			}
+
+			// X = [4]kG, left in extended coordinates
+			ufe p2b;
+			ec_mul_gen(key, X[n], p2b);
+			if (mul4 != 0) {
+				ec_dbl(X[n], X[n], false, p2b);
+				ec_dbl(X[n], X[n], false, p2b);
+			}
+
+#ifndef CAT_ENDIAN_LITTLE
+			CAT_SECURE_OBJCLR(key);
+#endif // CAT_ENDIAN_LITTLE
+
+			index[n++] = ii;
+			results[ii] = 0;
+		}
+
+		// If there is nothing to convert,
+		if (n <= 0) {
+			continue;
+		}
+
+		// Compute affine coordinates with one shared inversion
+		ec_affine_batch(X, r, scratch, n);
+
+		for (int jj = 0; jj < n; ++jj) {
+#ifndef CAT_ENDIAN_LITTLE
+			// Save result endian-neutral
+			ec_save_xy(r[jj], (u8*)R[index[jj]]);
+#else
+			// Copy out with memcpy() since R[] may not be 16-byte aligned
+			memcpy(R[index[jj]], &r[jj], sizeof(ecpt_affine));
+#endif // CAT_ENDIAN_LITTLE
+		}
+	}
+
+	CAT_SECURE_OBJCLR(X);
+	CAT_SECURE_OBJCLR(r);
+	CAT_SECURE_OBJCLR(scratch);
+
+	return failures > 0 ? -1 : 0;
+}
+
 int snowshoe_simul_gen(const char a[32], const char b[32], const char Q[64], char R[64]) {
 #ifndef CAT_ENDIAN_LITTLE
 	u64 k1[4+4];
@@ -526,7 +689,7 @@ int snowshoe_simul_gen(const char a[32], const char b[32], const char Q[64], cha
 	ec_load_xy((const u8*)Q, p2);
 
 	// Validate point
-	if (!ec_valid(p2)) {
+	if (!ec_valid_vartime(p2)) {
 		return -1;
 	}
 
@@ -562,6 +725,53 @@ int snowshoe_simul_gen(const char a[32], const char b[32], const char Q[64], cha
 	return 0;
 }
 
+int snowshoe_simul_gen_vartime(const char a[32], const char b[32], const char Q[64], char R[64]) {
+#ifndef CAT_ENDIAN_LITTLE
+	u64 k1[4], k2[4];
+	ec_load_k(a, k1);
+	ec_load_k(b, k2);
+
+	// Validate keys
+	if (invalid_key(k1) || invalid_key(k2)) {
+		return -1;
+	}
+
+	// Load point
+	ecpt_affine p2, r;
+	ec_load_xy((const u8*)Q, p2);
+
+	// Validate point
+	if (!ec_valid_vartime(p2)) {
+		return -1;
+	}
+
+	// Multiply
+	ec_simul_gen_vartime(k1, k2, p2, r);
+
+	// Save result endian-neutral
+	ec_save_xy(r, (u8*)R);
+#else
+	const u64 *k1 = (const u64 *)a;
+	const u64 *k2 = (const u64 *)b;
+	const ecpt_affine *p2 = (const ecpt_affine *)Q;
+
+	// Validate keys
+	if (invalid_key(k1) || invalid_key(k2)) {
+		return -1;
+	}
+
+	// Validate point
+	if (!ec_valid_vartime(*p2)) {
+		return -1;
+	}
+
+	// Multiply
+	ec_simul_gen_vartime(k1, k2, *p2, *(ecpt_affine *)R);
+#endif // CAT_ENDIAN_LITTLE
+
+	return 0;
+}
+
 int snowshoe_simul(const char a[32], const char P[64], const char b[32], const char Q[64], char R[64]) {
 #ifndef CAT_ENDIAN_LITTLE
 	u64 k1[4], k2[4];
@@ -579,7 +789,7 @@ int snowshoe_simul(const char a[32], const char P[64], const char b[32], const c
 	ec_load_xy((const u8*)Q, p2);
 
 	// Validate points
-	if (!ec_valid(p1) || !ec_valid(p2)) {
+	if (!ec_valid_vartime(p1) || !ec_valid_vartime(p2)) {
 		return -1;
 	}
 
@@ -589,7 +799,8 @@ int snowshoe_simul(const char a[32], const char P[64], const char b[32], const c
 	// Save result endian-neutral
 	ec_save_xy(r, (u8*)R);
 
-	CAT_SECURE_OBJCLR(k);
+	CAT_SECURE_OBJCLR(k1);
+	CAT_SECURE_OBJCLR(k2);
 	CAT_SECURE_OBJCLR(p1);
 	CAT_SECURE_OBJCLR(r);
 #else
@@ -615,6 +826,245 @@ int snowshoe_simul(const char a[32], const char P[64], const char b[32], const c
 	return 0;
 }
 
+int snowshoe_simul_batch(int count, const char *const a[], const char *const P[], const char *const b[], const char *const Q[], char *const R[], int results[]) {
+	ecpt X[BATCH_MAX];
+	ecpt_affine r[BATCH_MAX];
+	ufe scratch[BATCH_MAX];
+	int index[BATCH_MAX];
+	int failures = 0;
+
+	for (int offset = 0; offset < count; offset += BATCH_MAX) {
+		int n = 0;
+
+		for (int ii = offset; ii < count && ii < offset + BATCH_MAX; ++ii) {
+#ifndef CAT_ENDIAN_LITTLE
+			u64 k1[4], k2[4];
+			ec_load_k(a[ii], k1);
+			ec_load_k(b[ii], k2);
+
+			// Load points
+			ecpt_affine p1, p2;
+			ec_load_xy((const u8*)P[ii], p1);
+			ec_load_xy((const u8*)Q[ii], p2);
+#else
+			const u64 *k1 = (const u64 *)a[ii];
+			const u64 *k2 = (const u64 *)b[ii];
+			const ecpt_affine &p1 = *(const ecpt_affine *)P[ii];
+			const ecpt_affine &p2 = *(const ecpt_affine *)Q[ii];
+#endif // CAT_ENDIAN_LITTLE
+
+			// Validate keys and points
+			if (invalid_key(k1) || invalid_key(k2) ||
+				!ec_valid_vartime(p1) || !ec_valid_vartime(p2)) {
+				results[ii] = -1;
+				++failures;
+				continue;
+			}
+
+			// X = 4aP + 4bQ, left in extended coordinates
+			ec_simul_affine_ext(k1, p1, k2, p2, X[n]);
+
+#ifndef CAT_ENDIAN_LITTLE
+			CAT_SECURE_OBJCLR(k1);
+			CAT_SECURE_OBJCLR(k2);
+#endif // CAT_ENDIAN_LITTLE
+
+			index[n++] = ii;
+			results[ii] = 0;
+		}
+
+		// If there is nothing to convert,
+		if (n <= 0) {
+			continue;
+		}
+
+		// Compute affine coordinates with one shared inversion
+		ec_affine_batch(X, r, scratch, n);
+
+		for (int jj = 0; jj < n; ++jj) {
+#ifndef CAT_ENDIAN_LITTLE
+			// Save result endian-neutral
+			ec_save_xy(r[jj], (u8*)R[index[jj]]);
+#else
+			// Copy out with memcpy() since R[] may not be 16-byte aligned
+			memcpy(R[index[jj]], &r[jj], sizeof(ecpt_affine));
+#endif // CAT_ENDIAN_LITTLE
+		}
+	}
+
+	CAT_SECURE_OBJCLR(X);
+	CAT_SECURE_OBJCLR(r);
+	CAT_SECURE_OBJCLR(scratch);
+
+	return failures > 0 ? -1 : 0;
+}
+
+int snowshoe_sum_check(const char a[32], int count, const char *const k[], const char *const P[]) {
+#ifndef CAT_ENDIAN_LITTLE
+	u64 ka[4];
+	ec_load_k(a, ka);
+#else
+	const u64 *ka = (const u64 *)a;
+#endif // CAT_ENDIAN_LITTLE
+
+	// Validate scalar a
+	if (invalid_key(ka)) {
+		return -1;
+	}
+
+	// S = aG
+	ecpt S;
+	ec_sum_check_start(ka, S);
+
+	for (int offset = 0; offset < count; offset += SUM_GROUP_MAX) {
+		const int n = (count - offset < SUM_GROUP_MAX) ? (count - offset) : SUM_GROUP_MAX;
+
+#ifndef CAT_ENDIAN_LITTLE
+		// Load scalars and points for this group
+		u64 kg[SUM_GROUP_MAX][4];
+		ecpt_affine pg[SUM_GROUP_MAX];
+		const u64 *kp[SUM_GROUP_MAX];
+		const ecpt_affine *pp[SUM_GROUP_MAX];
+
+		for (int ii = 0; ii < n; ++ii) {
+			ec_load_k(k[offset + ii], kg[ii]);
+			ec_load_xy((const u8*)P[offset + ii], pg[ii]);
+			kp[ii] = kg[ii];
+			pp[ii] = &pg[ii];
+		}
+#else
+		const u64 *const *kp = (const u64 *const *)k + offset;
+		const ecpt_affine *const *pp = (const ecpt_affine *const *)P + offset;
+#endif // CAT_ENDIAN_LITTLE
+
+		// Validate scalars k[i] and points P[i]
+		for (int ii = 0; ii < n; ++ii) {
+			if (invalid_key(kp[ii]) || !ec_valid_vartime(*pp[ii])) {
+				return -1;
+			}
+		}
+
+		// S = S + sum(k[i] * P[i])
+		ec_sum_check_group_vartime(S, n, kp, pp);
+	}
+
+	// Check the sum
+	if (!ec_sum_check_finish_vartime(S)) {
+		return -1;
+	}
+
+	return 0;
+}
+
+int snowshoe_precomp(const char Q[64], char table[SNOWSHOE_PRECOMP_BYTES]) {
+#ifndef CAT_ENDIAN_LITTLE
+	// Load point
+	ecpt_affine q;
+	ec_load_xy((const u8*)Q, q);
+#else
+	const ecpt_affine &q = *(const ecpt_affine *)Q;
+#endif // CAT_ENDIAN_LITTLE
+
+	// Validate point
+	if (!ec_valid_vartime(q)) {
+		return -1;
+	}
+
+	// Build comb table
+	ec_gen_table_comb_84(q, (u8 *)table);
+
+	return 0;
+}
+
+int snowshoe_simul_precomp(const char a[32], const char P[64], const char h[32], const char table[SNOWSHOE_PRECOMP_BYTES], char R[64]) {
+#ifndef CAT_ENDIAN_LITTLE
+	u64 k1[4], k2[4];
+	ec_load_k(a, k1);
+	ec_load_k(h, k2);
+
+	// Validate keys
+	if (invalid_key(k1) || invalid_key(k2)) {
+		return -1;
+	}
+
+	// Load point
+	ecpt_affine p1, r;
+	ec_load_xy((const u8*)P, p1);
+
+	// Validate point
+	if (!ec_valid_vartime(p1)) {
+		return -1;
+	}
+
+	// Multiply
+	ec_simul_comb_affine(k1, p1, k2, (const u8 *)table, r);
+
+	// Save result endian-neutral
+	ec_save_xy(r, (u8*)R);
+
+	CAT_SECURE_OBJCLR(k1);
+	CAT_SECURE_OBJCLR(r);
+#else
+	const u64 *k1 = (const u64 *)a;
+	const u64 *k2 = (const u64 *)h;
+	const ecpt_affine *p1 = (const ecpt_affine *)P;
+
+	// Validate keys
+	if (invalid_key(k1) || invalid_key(k2)) {
+		return -1;
+	}
+
+	// Validate point
+	if (!ec_valid_vartime(*p1)) {
+		return -1;
+	}
+
+	// Multiply
+	ecpt_affine r;
+	ec_simul_comb_affine(k1, *p1, k2, (const u8 *)table, r);
+	memcpy(R, &r, sizeof(r));
+
+	CAT_SECURE_OBJCLR(r);
+#endif // CAT_ENDIAN_LITTLE
+
+	return 0;
+}
+
+int snowshoe_simul_gen_precomp(const char a[32], const char b[32], const char table[SNOWSHOE_PRECOMP_BYTES], char R[64]) {
+#ifndef CAT_ENDIAN_LITTLE
+	u64 k1[4], k2[4];
+	ec_load_k(a, k1);
+	ec_load_k(b, k2);
+
+	// Validate keys
+	if (invalid_key(k1) || invalid_key(k2)) {
+		return -1;
+	}
+
+	// Multiply
+	ecpt_affine r;
+	ec_simul_gen_comb_affine(k1, k2, (const u8 *)table, r);
+
+	// Save result endian-neutral
+	ec_save_xy(r, (u8*)R);
+#else
+	const u64 *k1 = (const u64 *)a;
+	const u64 *k2 = (const u64 *)b;
+
+	// Validate keys
+	if (invalid_key(k1) || invalid_key(k2)) {
+		return -1;
+	}
+
+	// Multiply
+	ecpt_affine r;
+	ec_simul_gen_comb_affine(k1, k2, (const u8 *)table, r);
+	memcpy(R, &r, sizeof(r));
+#endif // CAT_ENDIAN_LITTLE
+
+	return 0;
+}
+
 // E = Elligator(key)
 int snowshoe_elligator(const char key[32], char E[128]) {
 	// Calculate Elligator point from key
@@ -33,7 +33,7 @@
 extern "C" {
 #endif
 
-#define SNOWSHOE_VERSION 9
+#define SNOWSHOE_VERSION 16
 
 /*
  * Verify binary compatibility with the Snowshoe API on startup.
@@ -103,6 +103,29 @@ extern int snowshoe_valid(const char P[64]);
 
 extern int snowshoe_mul_gen(const char k[32], char R[64], char mul4);
 
+/*
+ * R[i] = k[i]*[4]*G, for i = 0..count-1
+ *
+ * Multiply the generator point by a batch of scalars
+ *
+ * Produces the same results as calling snowshoe_mul_gen() on each entry,
+ * except that the final conversion to affine coordinates is shared between
+ * entries, so only one field inversion is performed for each group of 32
+ * entries.  This is useful for generating many key pairs at once.
+ *
+ * Validates input scalars k[i].
+ *
+ * Preconditions:
+ *	0 < k[i] < q (prime order of curve)
+ *
+ * results[i] is set to 0 if entry i succeeded, or non-zero if its input
+ * scalar is invalid, in which case R[i] is left unmodified.
+ *
+ * Returns 0 if every entry succeeded.
+ * Returns non-zero if any of the entries failed.
+ */
+extern int snowshoe_mul_gen_batch(int count, const char *const k[], char *const R[], char mul4, int results[]);
+
 /*
  * R = k*4*P
  *
@@ -119,6 +142,29 @@ extern int snowshoe_mul_gen(const char k[32], char R[64], char mul4);
  */
 extern int snowshoe_mul(const char k[32], const char P[64], char R[64]);
 
+/*
+ * R[i] = k[i]*4*P[i], for i = 0..count-1
+ *
+ * Multiply a batch of variable points by their scalars
+ *
+ * Produces the same results as calling snowshoe_mul() on each entry, except
+ * that the final conversion to affine coordinates is shared between entries,
+ * so only one field inversion is performed for each group of 32 entries.
+ *
+ * Validates input scalars k[i].  Validates input points P[i].
+ *
+ * Preconditions:
+ * 	0 < k[i] < q (prime order of curve)
+ *
+ * results[i] is set to 0 if entry i succeeded, or non-zero if one of its
+ * input parameters is invalid, in which case R[i] is left unmodified.
+ *
+ * Returns 0 if every entry succeeded.
+ * Returns non-zero if any of the entries failed.
+ * It is important to check the return value to avoid active attacks.
+ */
+extern int snowshoe_mul_batch(int count, const char *const k[], const char *const P[], char *const R[], int results[]);
+
 /*
  * R = a*4*G + b*4*Q
  *
@@ -138,6 +184,27 @@ extern int snowshoe_mul(const char k[32], const char P[64], char R[64]);
  */
 extern int snowshoe_simul_gen(const char a[32], const char b[32], const char Q[64], char R[64]);
 
+/*
+ * R = a*4*G + b*4*Q
+ *
+ * Validates input scalars a,b.  Validates input point Q.
+ *
+ * Produces the same result as snowshoe_simul_gen(), but it uses wNAF
+ * recoding, direct table lookups and a variable-time inversion, so it is
+ * faster.
+ *
+ * WARNING: Not constant-time.  Only use this when all of the inputs are
+ * public knowledge, as in signature verification.
+ *
+ * Preconditions:
+ * 	0 < a,b < q (prime order of curve)
+ *
+ * Returns 0 on success.
+ * Returns non-zero if one of the input parameters is invalid.
+ * It is important to check the return value to avoid active attacks.
+ */
+extern int snowshoe_simul_gen_vartime(const char a[32], const char b[32], const char Q[64], char R[64]);
+
 /*
  * R = a*4*P + b*4*Q
  *
@@ -154,6 +221,106 @@ extern int snowshoe_simul_gen(const char a[32], const char b[32], const char Q[6
  */
 extern int snowshoe_simul(const char a[32], const char P[64], const char b[32], const char Q[64], char R[64]);
 
+/*
+ * R[i] = a[i]*4*P[i] + b[i]*4*Q[i], for i = 0..count-1
+ *
+ * Simultaneously multiply a batch of point pairs
+ *
+ * Produces the same results as calling snowshoe_simul() on each entry,
+ * except that the final conversion to affine coordinates is shared between
+ * entries, so only one field inversion is performed for each group of 32
+ * entries.
+ *
+ * Validates input scalars a[i],b[i].  Validates input points P[i],Q[i].
+ *
+ * Preconditions:
+ * 	0 < a[i],b[i] < q (prime order of curve)
+ *
+ * results[i] is set to 0 if entry i succeeded, or non-zero if one of its
+ * input parameters is invalid, in which case R[i] is left unmodified.
+ *
+ * Returns 0 if every entry succeeded.
+ * Returns non-zero if any of the entries failed.
+ * It is important to check the return value to avoid active attacks.
+ */
+extern int snowshoe_simul_batch(int count, const char *const a[], const char *const P[], const char *const b[], const char *const Q[], char *const R[], int results[]);
+
+/*
+ * Check that a*4*G + sum(k[i]*4*P[i], for i = 0..count-1) is the identity
+ *
+ * Validates input scalars a,k[i].  Validates input points P[i].
+ *
+ * WARNING: Not constant-time.  The input parameters should be public knowledge.
+ * This is used for batch signature verification, where a random linear
+ * combination of the verification equations should sum to the identity.
+ *
+ * Because of the multiplication by 4, points of small order in the sum are
+ * ignored.
+ *
+ * Preconditions:
+ * 	0 < a,k[i] < q (prime order of curve)
+ *
+ * Returns 0 if the sum is the identity element.
+ * Returns non-zero if it is not, or if one of the input parameters is invalid.
+ */
+extern int snowshoe_sum_check(const char a[32], int count, const char *const k[], const char *const P[]);
+
+/*
+ * Size of a table built by snowshoe_precomp()
+ */
+#define SNOWSHOE_PRECOMP_BYTES 49152
+
+/*
+ * Precompute a table for a point Q that is used many times
+ *
+ * Validates input point Q.  The table can then be passed to
+ * snowshoe_simul_precomp() or snowshoe_simul_gen_precomp() without
+ * validating Q again.  The table does not need to be aligned in memory, and
+ * it may be copied.
+ *
+ * Returns 0 on success.
+ * Returns non-zero if the input point is invalid.
+ */
+extern int snowshoe_precomp(const char Q[64], char table[SNOWSHOE_PRECOMP_BYTES]);
+
+/*
+ * R = a*4*(P + h*Q), where table was built from Q by snowshoe_precomp()
+ *
+ * This is the same as snowshoe_simul(a, P, b, Q, R) with b = a*h (mod q),
+ * and it is about 10% faster.  The multiplication by h is performed in
+ * variable time, so h must be public.  The multiplication by a is performed
+ * in constant time.
+ *
+ * Validates input scalars a,h.  Validates input point P.
+ *
+ * Preconditions:
+ * 	0 < a,h < q (prime order of curve)
+ *
+ * Returns 0 on success.
+ * Returns non-zero if one of the input parameters is invalid.
+ * It is important to check the return value to avoid active attacks.
+ */
+extern int snowshoe_simul_precomp(const char a[32], const char P[64], const char h[32], const char table[SNOWSHOE_PRECOMP_BYTES], char R[64]);
+
+/*
+ * R = a*4*G + b*4*Q, where table was built from Q by snowshoe_precomp()
+ *
+ * This is the same as snowshoe_simul_gen(a, b, Q, R), and it is about twice
+ * as fast, because both products use fixed-base combs.  Q is not validated
+ * again since snowshoe_precomp() already did that.
+ *
+ * WARNING: Not constant-time.  The input parameters a,b should be public knowledge.
+ * This is used mainly for signature verification against a long-lived key.
+ *
+ * Preconditions:
+ * 	0 < a,b < q (prime order of curve)
+ *
+ * Returns 0 on success.
+ * Returns non-zero if one of the input parameters is invalid.
+ * It is important to check the return value to avoid active attacks.
+ */
+extern int snowshoe_simul_gen_precomp(const char a[32], const char b[32], const char table[SNOWSHOE_PRECOMP_BYTES], char R[64]);
+
 /*
  * E = Elligator(key)
  *
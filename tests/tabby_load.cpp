@@ -0,0 +1,467 @@
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+using namespace std;
+
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "Clock.hpp"
+using namespace cat;
+
+#include "tabby.h"
+
+/*
+ * Handshake load generator
+ *
+ * Drives a Tabby server with many client threads and reports the rate of
+ * completed handshakes, how it scales with the number of threads, and the
+ * latency distribution of the server side.
+ *
+ * Usage: load [threads] [handshakes] [inproc|udp]
+ *
+ * The client requests are generated with tabby_client_rekey() before the
+ * timed window, and every response is checked with tabby_client_handshake()
+ * after it, so the reported rate covers only the server side.  In the
+ * default "inproc" mode the client threads call tabby_worker_handshake()
+ * directly, and latency is the time spent in the server.  In "udp" mode each
+ * client thread talks to its own server thread over loopback UDP, and latency
+ * is the round trip.  The run is repeated for 1, 2, 4, ... threads up to the
+ * requested number.
+ */
+
+static Clock m_clock;
+
+// Defaults for the command line
+static const int DEFAULT_THREADS = 4;
+static const int DEFAULT_HANDSHAKES = 100000;
+
+// How long a UDP client waits for a response before counting it as lost
+static const int UDP_TIMEOUT_MSEC = 1000;
+
+// UDP requests and responses end with a sequence number, so that a
+// response arriving after its timeout is not taken for the next one
+static const int UDP_TAG_BYTES = 4;
+
+static tabby_server m_server;
+static char m_public_key[64];
+
+// One handshake, generated before the timed window and checked after it.
+// Snowshoe reads keys with 16-byte aligned loads, like the stack buffers
+// the compiler hands out, so the buffers here are aligned the same way.
+struct load_handshake {
+	tabby_client client CAT_ALIGNED(16);
+	char client_request[96] CAT_ALIGNED(16);
+
+	// Filled in during the timed window
+	char server_response[128] CAT_ALIGNED(16);
+	char server_secret_key[32] CAT_ALIGNED(16);
+	int server_result;
+	bool lost;
+};
+
+struct load_thread {
+	int id;
+
+	// Number of handshakes to perform
+	int count;
+
+	// Requests prepared for this thread
+	vector<load_handshake> handshakes;
+
+	// Worker used for the server side of this thread's handshakes
+	tabby_worker worker;
+
+	// Socket and address of the matching UDP server thread
+	int server_sock;
+	sockaddr_in server_addr;
+
+	pthread_t client_handle, server_handle;
+
+	// Results
+	vector<double> latency;
+	int failures, lost;
+};
+
+static double percentile(const vector<double> &sorted, double p) {
+	if (sorted.empty()) {
+		return 0;
+	}
+
+	size_t ii = (size_t)(p * sorted.size());
+	if (ii >= sorted.size()) {
+		ii = sorted.size() - 1;
+	}
+
+	return sorted[ii];
+}
+
+// Generate the client requests for a thread
+static int prepare_handshakes(load_thread *thread) {
+	tabby_client client;
+	char client_request[96];
+
+	if (tabby_client_gen(&client, &thread->id, sizeof(thread->id), client_request)) {
+		return -1;
+	}
+
+	thread->handshakes.resize(thread->count);
+
+	for (int ii = 0; ii < thread->count; ++ii) {
+		load_handshake *hs = &thread->handshakes[ii];
+
+		if (tabby_client_rekey(&client, &hs->client, 0, 0, hs->client_request)) {
+			tabby_erase(&client, sizeof(client));
+			return -1;
+		}
+
+		hs->server_result = -1;
+		hs->lost = false;
+	}
+
+	tabby_erase(&client, sizeof(client));
+
+	return 0;
+}
+
+// Check the responses a thread received, counting failures
+static void check_handshakes(load_thread *thread, bool udp) {
+	for (int ii = 0; ii < thread->count; ++ii) {
+		load_handshake *hs = &thread->handshakes[ii];
+		char client_secret_key[32];
+
+		// If the request or response was dropped,
+		if (hs->lost) {
+			continue;
+		}
+
+		// The UDP server keeps its secret key, so only the client side is checked
+		if (hs->server_result ||
+			tabby_client_handshake(&hs->client, m_public_key, hs->server_response, client_secret_key) ||
+			(!udp && memcmp(hs->server_secret_key, client_secret_key, 32) != 0)) {
+			++thread->failures;
+		}
+
+		tabby_erase(client_secret_key, 32);
+	}
+
+	if (!thread->handshakes.empty()) {
+		tabby_erase(&thread->handshakes[0], thread->handshakes.size() * sizeof(load_handshake));
+		thread->handshakes.clear();
+	}
+}
+
+// Client thread that calls the server directly
+static void *inproc_client_func(void *param) {
+	load_thread *thread = (load_thread *)param;
+
+	for (int ii = 0; ii < thread->count; ++ii) {
+		load_handshake *hs = &thread->handshakes[ii];
+
+		double t0 = m_clock.usec();
+
+		hs->server_result = tabby_worker_handshake(&thread->worker, hs->client_request, hs->server_response, hs->server_secret_key);
+
+		double t1 = m_clock.usec();
+
+		thread->latency.push_back(t1 - t0);
+	}
+
+	return 0;
+}
+
+// Server thread that answers requests on its own UDP socket
+static void *udp_server_func(void *param) {
+	load_thread *thread = (load_thread *)param;
+
+	for (;;) {
+		char client_request[96 + UDP_TAG_BYTES + 1];
+		sockaddr_in from;
+		socklen_t from_len = sizeof(from);
+
+		const ssize_t bytes = recvfrom(thread->server_sock, client_request, sizeof(client_request), 0, (sockaddr *)&from, &from_len);
+
+		// A short datagram from the main thread stops the server
+		if (bytes >= 0 && bytes < 96 + UDP_TAG_BYTES) {
+			break;
+		}
+
+		// Ignore anything else that is not a request
+		if (bytes != 96 + UDP_TAG_BYTES) {
+			continue;
+		}
+
+		char server_response[128 + UDP_TAG_BYTES];
+		char server_secret_key[32];
+
+		if (tabby_worker_handshake(&thread->worker, client_request, server_response, server_secret_key)) {
+			continue;
+		}
+
+		// Echo the sequence number of the request
+		memcpy(server_response + 128, client_request + 96, UDP_TAG_BYTES);
+
+		sendto(thread->server_sock, server_response, sizeof(server_response), 0, (const sockaddr *)&from, from_len);
+
+		tabby_erase(server_secret_key, 32);
+	}
+
+	return 0;
+}
+
+// Client thread that sends requests to its server thread over UDP
+static void *udp_client_func(void *param) {
+	load_thread *thread = (load_thread *)param;
+
+	const int sock = socket(AF_INET, SOCK_DGRAM, 0);
+	if (sock < 0) {
+		thread->failures = thread->count;
+		return 0;
+	}
+
+	timeval timeout;
+	timeout.tv_sec = UDP_TIMEOUT_MSEC / 1000;
+	timeout.tv_usec = (UDP_TIMEOUT_MSEC % 1000) * 1000;
+	setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+	for (int ii = 0; ii < thread->count; ++ii) {
+		load_handshake *hs = &thread->handshakes[ii];
+		const u32 seq = (u32)ii;
+
+		char client_request[96 + UDP_TAG_BYTES];
+		memcpy(client_request, hs->client_request, 96);
+		memcpy(client_request + 96, &seq, UDP_TAG_BYTES);
+
+		char server_response[128 + UDP_TAG_BYTES];
+		ssize_t bytes;
+
+		double t0 = m_clock.usec();
+
+		sendto(sock, client_request, sizeof(client_request), 0, (const sockaddr *)&thread->server_addr, sizeof(thread->server_addr));
+
+		// Skip late responses to earlier requests
+		do {
+			bytes = recv(sock, server_response, sizeof(server_response), 0);
+		} while (bytes == sizeof(server_response) && memcmp(server_response + 128, &seq, UDP_TAG_BYTES) != 0);
+
+		double t1 = m_clock.usec();
+
+		// If the request or response was dropped,
+		if (bytes != sizeof(server_response)) {
+			hs->lost = true;
+			++thread->lost;
+			continue;
+		}
+
+		thread->latency.push_back(t1 - t0);
+
+		memcpy(hs->server_response, server_response, 128);
+		hs->server_result = 0;
+	}
+
+	close(sock);
+
+	return 0;
+}
+
+// Bind a server socket for the thread on an ephemeral loopback port
+static int udp_server_bind(load_thread *thread) {
+	thread->server_sock = socket(AF_INET, SOCK_DGRAM, 0);
+	if (thread->server_sock < 0) {
+		return -1;
+	}
+
+	memset(&thread->server_addr, 0, sizeof(thread->server_addr));
+	thread->server_addr.sin_family = AF_INET;
+	thread->server_addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	thread->server_addr.sin_port = 0;
+
+	socklen_t addr_len = sizeof(thread->server_addr);
+
+	if (bind(thread->server_sock, (const sockaddr *)&thread->server_addr, sizeof(thread->server_addr)) ||
+		getsockname(thread->server_sock, (sockaddr *)&thread->server_addr, &addr_len)) {
+		close(thread->server_sock);
+		return -1;
+	}
+
+	return 0;
+}
+
+// Stop a server thread by sending it a short datagram
+static void udp_server_stop(load_thread *thread) {
+	const int sock = socket(AF_INET, SOCK_DGRAM, 0);
+	if (sock >= 0) {
+		const char stop = 0;
+		sendto(sock, &stop, 1, 0, (const sockaddr *)&thread->server_addr, sizeof(thread->server_addr));
+		close(sock);
+	}
+
+	pthread_join(thread->server_handle, 0);
+
+	close(thread->server_sock);
+}
+
+// Run one load test with the given number of threads, returning handshakes/second
+static double run(int thread_count, int handshakes, bool udp, double base_rate) {
+	vector<load_thread> threads(thread_count);
+
+	// Workers must be created before the threads that use them are started
+	for (int ii = 0; ii < thread_count; ++ii) {
+		load_thread *thread = &threads[ii];
+
+		thread->id = ii;
+		thread->count = handshakes / thread_count + (ii < handshakes % thread_count ? 1 : 0);
+		thread->failures = 0;
+		thread->lost = 0;
+		thread->latency.reserve(thread->count);
+
+		if (prepare_handshakes(thread)) {
+			cout << "FAILURE: Unable to generate client requests" << endl;
+			exit(1);
+		}
+
+		if (tabby_worker_gen(&thread->worker, &m_server, &ii, sizeof(ii))) {
+			cout << "FAILURE: Unable to create worker" << endl;
+			exit(1);
+		}
+
+		if (udp) {
+			if (udp_server_bind(thread)) {
+				cout << "FAILURE: Unable to bind UDP socket" << endl;
+				exit(1);
+			}
+
+			if (pthread_create(&thread->server_handle, 0, udp_server_func, thread)) {
+				cout << "FAILURE: Unable to start server thread" << endl;
+				exit(1);
+			}
+		}
+	}
+
+	double t0 = m_clock.usec();
+
+	for (int ii = 0; ii < thread_count; ++ii) {
+		if (pthread_create(&threads[ii].client_handle, 0, udp ? udp_client_func : inproc_client_func, &threads[ii])) {
+			cout << "FAILURE: Unable to start client thread" << endl;
+			exit(1);
+		}
+	}
+
+	for (int ii = 0; ii < thread_count; ++ii) {
+		pthread_join(threads[ii].client_handle, 0);
+	}
+
+	double t1 = m_clock.usec();
+
+	vector<double> latency;
+	int failures = 0, lost = 0;
+
+	for (int ii = 0; ii < thread_count; ++ii) {
+		load_thread *thread = &threads[ii];
+
+		if (udp) {
+			udp_server_stop(thread);
+		}
+
+		check_handshakes(thread, udp);
+
+		latency.insert(latency.end(), thread->latency.begin(), thread->latency.end());
+		failures += thread->failures;
+		lost += thread->lost;
+
+		tabby_erase(&thread->worker, sizeof(thread->worker));
+	}
+
+	sort(latency.begin(), latency.end());
+
+	const double rate = latency.size() * 1000000.0 / (t1 - t0);
+
+	cout << setw(7) << thread_count
+		 << setw(12) << (int)rate
+		 << setw(9) << fixed << setprecision(2) << (base_rate > 0 ? rate / base_rate : 1.0)
+		 << setw(10) << setprecision(1) << percentile(latency, 0.5)
+		 << setw(10) << percentile(latency, 0.9)
+		 << setw(10) << percentile(latency, 0.99)
+		 << setw(10) << percentile(latency, 0.999)
+		 << setw(10) << (latency.empty() ? 0 : latency.back())
+		 << setw(9) << failures
+		 << setw(7) << lost << endl;
+
+	if (failures > 0) {
+		cout << "FAILURE: " << failures << " handshakes did not produce matching keys" << endl;
+		exit(1);
+	}
+
+	return rate;
+}
+
+int main(int argc, char *argv[]) {
+	int max_threads = DEFAULT_THREADS;
+	int handshakes = DEFAULT_HANDSHAKES;
+	bool udp = false;
+
+	if (argc > 1) {
+		max_threads = atoi(argv[1]);
+	}
+	if (argc > 2) {
+		handshakes = atoi(argv[2]);
+	}
+	if (argc > 3) {
+		udp = (strcmp(argv[3], "udp") == 0);
+	}
+
+	if (max_threads <= 0 || handshakes <= 0) {
+		cout << "Usage: " << argv[0] << " [threads] [handshakes] [inproc|udp]" << endl;
+		return 1;
+	}
+
+	cout << "Tabby Load Generator" << endl;
+
+	m_clock.OnInitialize();
+
+	if (tabby_init()) {
+		cout << "FAILURE: Unable to initialize Tabby" << endl;
+		return 1;
+	}
+
+	if (tabby_server_gen(&m_server, 0, 0) ||
+		tabby_server_get_public_key(&m_server, m_public_key)) {
+		cout << "FAILURE: Unable to generate server key" << endl;
+		return 1;
+	}
+
+	cout << handshakes << " handshakes per run, " << (udp ? "loopback UDP" : "in-process") << ", latency in usec" << endl;
+	cout << "threads  hs/second  scaling       p50       p90       p99     p99.9       max failures   lost" << endl;
+
+	double base_rate = 0;
+
+	for (int thread_count = 1; ; thread_count *= 2) {
+		if (thread_count > max_threads) {
+			thread_count = max_threads;
+		}
+
+		const double rate = run(thread_count, handshakes, udp, base_rate);
+
+		if (base_rate <= 0) {
+			base_rate = rate;
+		}
+
+		if (thread_count >= max_threads) {
+			break;
+		}
+	}
+
+	tabby_erase(&m_server, sizeof(m_server));
+
+	m_clock.OnFinalize();
+
+	return 0;
+}
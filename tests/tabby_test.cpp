@@ -1,12 +1,14 @@
 #include <iostream>
 #include <cassert>
 #include <vector>
+#include <cstdio>
 using namespace std;
 
 #include "Clock.hpp"
 using namespace cat;
 
 #include "tabby.h"
+#include "snowshoe.h"
 
 static Clock m_clock;
 
@@ -75,6 +77,137 @@ static void tscTime() {
 }
 
 
+// Fill a buffer with bytes from a simple deterministic generator
+static void fill_test_bytes(u32 &seed, char *x, int bytes) {
+	for (int ii = 0; ii < bytes; ++ii) {
+		seed = seed * 1103515245 + 12345;
+		x[ii] = (char)(seed >> 16);
+	}
+}
+
+// Check that R = a*4*G + b*4*Q matches between the two versions
+static void check_simul_gen(const char a[32], const char b[32], const char Q[64]) {
+	char R0[64], R1[64];
+
+	const int r0 = snowshoe_simul_gen(a, b, Q, R0);
+	const int r1 = snowshoe_simul_gen_vartime(a, b, Q, R1);
+
+	assert((r0 == 0) == (r1 == 0));
+	assert(r0 || 0 == memcmp(R0, R1, 64));
+}
+
+static void simul_gen_vartime_test() {
+	// q - 1
+	static const unsigned char QM1[32] = {
+		0xA4, 0x01, 0x9E, 0xB0, 0xE3, 0x68, 0x9B, 0xCE,
+		0xD3, 0x87, 0xDC, 0xC0, 0x14, 0x14, 0x26, 0xA6,
+		0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+		0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0x0F
+	};
+
+	// Eigenvalue of the GLS endomorphism, which decomposes with a zero
+	// first subscalar.  Scalars below 2^126 have a zero second subscalar.
+	static const unsigned char LAMBDA[32] = {
+		0x16, 0x0C, 0x11, 0xF3, 0xCB, 0x0B, 0xA2, 0x02,
+		0x07, 0x92, 0x47, 0xE2, 0x77, 0x4F, 0xFE, 0xFD,
+		0x1C, 0xD4, 0x4B, 0x34, 0xF3, 0xB7, 0x56, 0x4F,
+		0xE5, 0xF1, 0x7D, 0xF9, 0x7F, 0xEF, 0x3D, 0x01
+	};
+
+	static const int EDGE_COUNT = 7;
+	char edges[EDGE_COUNT][32] = {};
+
+	// 0, 1, q - 1, 2^124, 2^124 + 1, lambda, 5 * lambda
+	edges[1][0] = 1;
+	memcpy(edges[2], QM1, 32);
+	edges[3][15] = 0x10;
+	edges[4][15] = 0x10;
+	edges[4][0] = 1;
+	memcpy(edges[5], LAMBDA, 32);
+	char five[32] = { 5 };
+	snowshoe_mul_mod_q(edges[5], five, 0, edges[6]);
+
+	u32 seed = 1;
+
+	for (int ii = 0; ii < 100; ++ii) {
+		char x[64], a[32], b[32], k[32], Q[64];
+
+		fill_test_bytes(seed, x, 64);
+		snowshoe_mod_q(x, a);
+		fill_test_bytes(seed, x, 64);
+		snowshoe_mod_q(x, b);
+		fill_test_bytes(seed, x, 64);
+		snowshoe_mod_q(x, k);
+		assert(0 == snowshoe_mul_gen(k, Q, 0));
+
+		// Random scalars
+		check_simul_gen(a, b, Q);
+
+		// Edge scalars in either position
+		for (int jj = 0; jj < EDGE_COUNT; ++jj) {
+			check_simul_gen(edges[jj], b, Q);
+			check_simul_gen(a, edges[jj], Q);
+			check_simul_gen(edges[jj], edges[(jj + ii) % EDGE_COUNT], Q);
+		}
+	}
+}
+
+// Signatures made before the keyed BLAKE2 state for the sign key was cached,
+// for a fixed key and messages around the BLAKE2 block size
+static void sign_known_answer_test() {
+	static const int LENGTHS[4] = { 1, 128, 129, 300 };
+	static const char *EXPECTED[4] = {
+		"365986b28f5abd047840725c8b06ff1356a1dff9f132dd074cf8be4998619036b4d132d31bc8ad638375ac87f7ac121f"
+		"01a4e3429002b45daf9ae48cfacd4b3e1c48b23a9e5b05b312211196e11e3889edaa6e7b52140264ff9434eb7a71a508",
+		"8f3614b3457a8a19b4541a34cea00853a3f7f1f5b133e3cd5ba93761fc559525689849a641f150dba31a8a67af805d26"
+		"f90a8d48b644e178f963402d3e4290715f369a4ce37de9cbbc646c0b572b8041130d65422a80db82e22f3f30a681cd0f",
+		"1d00a9cb6a78f3c0c9ca42ecb193a7350126e33f72bf51e6c6dfa81fd2177b42d1379bd29030599ce78e1c10502af978"
+		"41bdeb609c7ad0cd77390c115eab972a3cb8c7c8b29d9543957187c53c1270842555881487c18a24e8c64330bf0e750e",
+		"784ae5feafea202a6b997c4141869e6d44d7b3ed34cce448a925f1d13af4c05cca3628a0a124414c02cd1c7322414938"
+		"f5861f7a38ca3913273816d9821a5142600de024a6d0f4ec2420b7486ae423686073376e75df956676fb9eb23ad5f302"
+	};
+
+	char server_data[64];
+	for (int ii = 0; ii < 64; ++ii) {
+		server_data[ii] = (char)(ii * 7 + 1);
+	}
+	server_data[31] = 1;
+
+	tabby_server s;
+	assert(0 == tabby_server_load_secret(&s, 0, 0, server_data));
+
+	char message[300];
+	for (int ii = 0; ii < 300; ++ii) {
+		message[ii] = (char)(ii ^ 0x5a);
+	}
+
+	for (int ii = 0; ii < 4; ++ii) {
+		char expected[96], signature[96];
+		for (int jj = 0; jj < 96; ++jj) {
+			unsigned int x;
+			assert(1 == sscanf(EXPECTED[ii] + jj * 2, "%2x", &x));
+			expected[jj] = (char)x;
+		}
+
+		assert(0 == tabby_sign(&s, message, LENGTHS[ii], signature));
+		assert(0 == memcmp(signature, expected, 96));
+
+		// Same signature from two pieces and from the batch API
+		const tabby_iovec pieces[2] = {
+			{ message, LENGTHS[ii] / 2 },
+			{ message + LENGTHS[ii] / 2, LENGTHS[ii] - LENGTHS[ii] / 2 }
+		};
+		assert(0 == tabby_signv(&s, pieces, 2, signature));
+		assert(0 == memcmp(signature, expected, 96));
+
+		const void *message_list[1] = { message };
+		char *signature_list[1] = { signature };
+		assert(0 == tabby_sign_batch(&s, 1, message_list, &LENGTHS[ii], signature_list, 0));
+		assert(0 == memcmp(signature, expected, 96));
+	}
+
+	tabby_erase(&s, sizeof(s));
+}
 
 int main() {
 	cout << "Tabby Tester" << endl;
@@ -87,6 +220,12 @@ int main() {
 
 	tscTime();
 
+	// Variable-time simultaneous multiplication test:
+
+	simul_gen_vartime_test();
+
+	cout << "+ Variable-time simultaneous multiplication matches the constant-time version" << endl;
+
 	// Initialize server offline:
 
 	cout << "Generating a 256-bit entropy server key..." << endl;
@@ -172,95 +311,1754 @@ int main() {
 
 	cout << "+ Signature validation test successful!" << endl;
 
-	// Handshake test:
+	sign_known_answer_test();
 
-	cout << "Generating a 256-bit entropy client key..." << endl;
+	cout << "+ Signatures match the known answers" << endl;
 
-	t0 = m_clock.usec();
-	c0 = Clock::cycles();
+	// Batch signing test:
 
-	tabby_client c;
-	char client_request[96];
+	static const int SIGN_COUNT = 100;
 
-	assert(0 == tabby_client_gen(&c, 0, 0, client_request));
+	vector<char> bmessages(SIGN_COUNT * 64);
+	vector<char> bsignatures(SIGN_COUNT * 96);
+	vector<const void *> bmessage_list(SIGN_COUNT);
+	vector<int> bbytes(SIGN_COUNT);
+	vector<char *> bsignature_list(SIGN_COUNT);
+	vector<int> bresults(SIGN_COUNT);
 
-	c1 = Clock::cycles();
-	t1 = m_clock.usec();
+	vector<u32> tsb;
+	double wsb = 0;
 
-	cout << "+ Generated a client key in " << (c1 - c0) << " cycles, " << (t1 - t0) << " usec (one sample)" << endl;
+	for (int ii = 0; ii < 100; ++ii) {
+		for (int jj = 0; jj < SIGN_COUNT; ++jj) {
+			char *message = &bmessages[jj * 64];
+			bbytes[jj] = 1 + (ii + jj) % 64;
 
-	vector<u32> tr, ts, tc;
-	double wr = 0, ws = 0, wc = 0;
+			for (int kk = 0; kk < bbytes[jj]; ++kk) {
+				message[kk] = (char)(ii * 3 + jj + kk);
+			}
+
+			bmessage_list[jj] = message;
+			bsignature_list[jj] = &bsignatures[jj * 96];
+		}
+
+		t0 = m_clock.usec();
+		c0 = Clock::cycles();
+
+		assert(0 == tabby_sign_batch(&s, SIGN_COUNT, &bmessage_list[0], &bbytes[0], &bsignature_list[0], &bresults[0]));
+
+		c1 = Clock::cycles();
+		t1 = m_clock.usec();
+
+		tsb.push_back((c1 - c0) / SIGN_COUNT);
+		wsb += (t1 - t0) / SIGN_COUNT;
+
+		// Same signatures as tabby_sign()
+		for (int jj = 0; jj < SIGN_COUNT; ++jj) {
+			char signature[96];
+
+			assert(bresults[jj] == 0);
+			assert(0 == tabby_sign(&s, bmessage_list[jj], bbytes[jj], signature));
+			assert(0 == memcmp(signature, bsignature_list[jj], 96));
+		}
+	}
+
+	u32 msb = quick_select(&tsb[0], (int)tsb.size());
+	wsb /= tsb.size();
+
+	cout << "+ Tabby batch sign: `" << dec << msb << "` median cycles, `" << wsb << "` avg usec per signature" << endl;
+
+	// Scatter/gather signing test:
+
+	{
+		char message[200];
+		for (int jj = 0; jj < (int)sizeof(message); ++jj) {
+			message[jj] = (char)(jj * 5 + 1);
+		}
+
+		tabby_iovec pieces[3];
+		char signature1[96], signature2[96];
+
+		// Empty and invalid piece lists are rejected
+		pieces[0].data = message;
+		pieces[0].bytes = 0;
+		assert(0 != tabby_signv(&s, pieces, 0, signature1));
+		assert(0 != tabby_signv(&s, pieces, 1, signature1));
+		pieces[0].bytes = -1;
+		assert(0 != tabby_signv(&s, pieces, 1, signature1));
+		pieces[0].data = 0;
+		pieces[0].bytes = 10;
+		assert(0 != tabby_signv(&s, pieces, 1, signature1));
+
+		vector<u32> tsv2;
+		double wsv2 = 0;
+
+		for (int ii = 0; ii < 1000; ++ii) {
+			// Header, payload and trailer, any of which may be empty
+			const int header_bytes = ii % 17;
+			const int trailer_bytes = (ii / 17) % 9;
+			const int payload_bytes = (int)sizeof(message) - header_bytes - trailer_bytes;
+
+			pieces[0].data = message;
+			pieces[0].bytes = header_bytes;
+			pieces[1].data = message + header_bytes;
+			pieces[1].bytes = payload_bytes;
+			pieces[2].data = message + header_bytes + payload_bytes;
+			pieces[2].bytes = trailer_bytes;
+
+			message[ii % sizeof(message)] ^= 1;
 
-	for (int ii = 0; ii < 10000; ++ii) {
-		if (ii == 1000) {
 			t0 = m_clock.usec();
 			c0 = Clock::cycles();
 
-			tabby_server_rekey(&s, 0, 0);
+			assert(0 == tabby_signv(&s, pieces, 3, signature1));
 
 			c1 = Clock::cycles();
 			t1 = m_clock.usec();
 
-			cout << "+ Periodic server rekey in " << (c1 - c0) << " cycles, " << (t1 - t0) << " usec" << endl;
+			tsv2.push_back(c1 - c0);
+			wsv2 += t1 - t0;
+
+			// Same signature as the message in one buffer
+			assert(0 == tabby_sign(&s, message, sizeof(message), signature2));
+			assert(0 == memcmp(signature1, signature2, 96));
+
+			assert(0 == tabby_verifyv(pieces, 3, public_key, signature1));
+			assert(0 == tabby_verify(message, sizeof(message), public_key, signature1));
+
+			// Dropping a non-empty piece or changing one is rejected
+			assert(0 != tabby_verifyv(pieces + 1, 2, public_key, signature1) || header_bytes == 0);
+			message[(ii * 7) % sizeof(message)] ^= 4;
+			assert(0 != tabby_verifyv(pieces, 3, public_key, signature1));
+			message[(ii * 7) % sizeof(message)] ^= 4;
+		}
+
+		u32 msv2 = quick_select(&tsv2[0], (int)tsv2.size());
+		wsv2 /= tsv2.size();
+
+		cout << "+ Tabby sign from 3 pieces: `" << dec << msv2 << "` median cycles, `" << wsv2 << "` avg usec" << endl;
+	}
+
+	// Nonce pool signing test:
+
+	{
+		char message[64];
+		char signature1[96], signature2[96];
+
+		for (int jj = 0; jj < 64; ++jj) {
+			message[jj] = (char)(jj * 11);
+		}
+
+		assert(0 == tabby_server_nonce_pool_start(&s, 64));
+		assert(0 != tabby_server_nonce_pool_start(&s, 64));
+
+		// Pooled nonces are random, so signatures of the same message differ
+		assert(0 == tabby_sign(&s, message, 64, signature1));
+		assert(0 == tabby_sign(&s, message, 64, signature2));
+		assert(0 != memcmp(signature1, signature2, 96));
+		assert(0 == tabby_verify(message, 64, public_key, signature1));
+		assert(0 == tabby_verify(message, 64, public_key, signature2));
+
+		vector<u32> tsp;
+		double wsp = 0;
+
+		// Sign more than the pool holds, so some may fall back
+		for (int ii = 0; ii < 1000; ++ii) {
+			message[ii % 64] ^= 1;
+
+			t0 = m_clock.usec();
+			c0 = Clock::cycles();
+
+			assert(0 == tabby_sign(&s, message, 64, signature1));
+
+			c1 = Clock::cycles();
+			t1 = m_clock.usec();
+
+			tsp.push_back(c1 - c0);
+			wsp += t1 - t0;
+
+			assert(0 == tabby_verify(message, 64, public_key, signature1));
+			signature1[ii % 96] ^= 1;
+			assert(0 != tabby_verify(message, 64, public_key, signature1));
+		}
+
+		assert(0 == tabby_server_nonce_pool_stop(&s));
+		assert(0 == tabby_server_nonce_pool_stop(&s));
+
+		// Without the pool, signatures are deterministic again
+		assert(0 == tabby_sign(&s, message, 64, signature1));
+		assert(0 == tabby_sign(&s, message, 64, signature2));
+		assert(0 == memcmp(signature1, signature2, 96));
+
+		u32 msp = quick_select(&tsp[0], (int)tsp.size());
+		wsp /= tsp.size();
+
+		cout << "+ Tabby sign with nonce pool: `" << dec << msp << "` median cycles, `" << wsp << "` avg usec" << endl;
+	}
+
+	// Batch signature verification test:
+
+	static const int VERIFY_COUNT = 64;
+
+	tabby_server s2;
+	char public_key2[64];
+
+	assert(0 == tabby_server_gen(&s2, 0, 0));
+	assert(0 == tabby_server_get_public_key(&s2, public_key2));
+
+	vector<char> vmessages(VERIFY_COUNT * 100);
+	vector<char> vsignatures(VERIFY_COUNT * 96);
+	vector<const void *> vmessage_list(VERIFY_COUNT);
+	vector<int> vbytes(VERIFY_COUNT);
+	vector<const char *> vkey_list(VERIFY_COUNT);
+	vector<const char *> vsignature_list(VERIFY_COUNT);
+	vector<int> vresults(VERIFY_COUNT);
+
+	vector<u32> tvb;
+	double wvb = 0;
+
+	for (int ii = 0; ii < 100; ++ii) {
+		for (int jj = 0; jj < VERIFY_COUNT; ++jj) {
+			char *message = &vmessages[jj * 100];
+			char *signature = &vsignatures[jj * 96];
+
+			vbytes[jj] = 1 + (ii + jj) % 100;
+			for (int kk = 0; kk < vbytes[jj]; ++kk) {
+				message[kk] = (char)(ii * 7 + jj * 3 + kk);
+			}
+
+			// Alternate between the two keys
+			tabby_server *signer = (jj & 1) ? &s2 : &s;
+			assert(0 == tabby_sign(signer, message, vbytes[jj], signature));
+
+			vmessage_list[jj] = message;
+			vkey_list[jj] = (jj & 1) ? public_key2 : public_key;
+			vsignature_list[jj] = signature;
+		}
+
+		// Corrupt one of the entries every so often
+		const int bad = (ii % 3 == 0) ? (ii % VERIFY_COUNT) : -1;
+		if (bad >= 0) {
+			switch (ii % 4) {
+			case 0: vmessages[bad * 100] ^= 1; break;
+			case 1: vsignatures[bad * 96 + 10] ^= 1; break;
+			case 2: vsignatures[bad * 96 + 70] ^= 1; break;
+			case 3: vkey_list[bad] = (bad & 1) ? public_key : public_key2; break;
+			}
 		}
 
 		t0 = m_clock.usec();
 		c0 = Clock::cycles();
 
-		assert(0 == tabby_client_rekey(&c, &c, 0, 0, client_request));
+		const int batch_result = tabby_verify_batch(VERIFY_COUNT, &vmessage_list[0], &vbytes[0], &vkey_list[0], &vsignature_list[0], &vresults[0]);
 
 		c1 = Clock::cycles();
 		t1 = m_clock.usec();
 
-		tr.push_back(c1 - c0);
-		wr += t1 - t0;
+		if (bad < 0) {
+			tvb.push_back((c1 - c0) / VERIFY_COUNT);
+			wvb += (t1 - t0) / VERIFY_COUNT;
+		}
 
-		char server_response[128];
-		char server_secret_key[32];
+		assert((bad >= 0) == (batch_result != 0));
+
+		for (int jj = 0; jj < VERIFY_COUNT; ++jj) {
+			assert((jj == bad) == (vresults[jj] != 0));
+		}
+	}
+
+	// A scalar that is not reduced mod q is rejected like tabby_verify() does
+	{
+		char *signature = &vsignatures[0];
+		assert(0 == tabby_sign(&s, &vmessages[0], vbytes[0], signature));
+		vkey_list[0] = public_key;
+		assert(0 == tabby_verify_batch(1, &vmessage_list[0], &vbytes[0], &vkey_list[0], &vsignature_list[0], 0));
+		memset(signature + 64, 0xff, 32);
+		assert(0 != tabby_verify(&vmessages[0], vbytes[0], public_key, signature));
+		assert(0 != tabby_verify_batch(1, &vmessage_list[0], &vbytes[0], &vkey_list[0], &vsignature_list[0], 0));
+	}
+
+	tabby_erase(&s2, sizeof(s2));
+
+	u32 mvb = quick_select(&tvb[0], (int)tvb.size());
+	wvb /= tvb.size();
+
+	cout << "+ Tabby batch verify signature: `" << dec << mvb << "` median cycles, `" << wvb << "` avg usec per signature" << endl;
+
+	// Verify context test:
+
+	tabby_verify_ctx vctx;
+
+	{
+		char bad_key[64];
+		memset(bad_key, 0xff, 64);
+		assert(0 != tabby_verify_ctx_gen(&vctx, bad_key));
+	}
+
+	t0 = m_clock.usec();
+	c0 = Clock::cycles();
+
+	assert(0 == tabby_verify_ctx_gen(&vctx, public_key));
+
+	c1 = Clock::cycles();
+	t1 = m_clock.usec();
+
+	cout << "+ Precomputed verify context in " << dec << (c1 - c0) << " cycles, " << (t1 - t0) << " usec (one sample)" << endl;
+
+	vector<u32> tvc;
+	double wvc = 0;
+
+	for (int ii = 0; ii < 10000; ++ii) {
+		char signature[96];
+		char message[64];
+		const int message_bytes = 64;
+
+		for (int jj = 0; jj < message_bytes; ++jj) {
+			message[jj] = (char)(ii + jj);
+		}
+
+		assert(0 == tabby_sign(&s, message, message_bytes, signature));
 
 		t0 = m_clock.usec();
 		c0 = Clock::cycles();
 
-		assert(0 == tabby_server_handshake(&s, client_request, server_response, server_secret_key));
+		assert(0 == tabby_verify_with_ctx(&vctx, message, message_bytes, signature));
 
 		c1 = Clock::cycles();
 		t1 = m_clock.usec();
 
-		ts.push_back(c1 - c0);
-		ws += t1 - t0;
+		tvc.push_back(c1 - c0);
+		wvc += t1 - t0;
 
-		char client_secret_key[32];
+		// Corrupted messages and signatures are rejected
+		message[ii % message_bytes] ^= 1;
+		assert(0 != tabby_verify_with_ctx(&vctx, message, message_bytes, signature));
+		message[ii % message_bytes] ^= 1;
+		signature[ii % 96] ^= 1;
+		assert(0 != tabby_verify_with_ctx(&vctx, message, message_bytes, signature));
+	}
+
+	tabby_verify_ctx_free(&vctx);
+
+	u32 mvc = quick_select(&tvc[0], (int)tvc.size());
+	wvc /= tvc.size();
+
+	cout << "+ Tabby verify signature with context: `" << dec << mvc << "` median cycles, `" << wvc << "` avg usec" << endl;
+
+	// Merkle batch signature test:
+
+	assert(tabby_merkle_proof_bytes(0) < 0);
+	assert(tabby_merkle_proof_bytes(1) == 8);
+	assert(tabby_merkle_proof_bytes(5) == 8 + 3 * 32);
+	assert(tabby_merkle_proof_bytes_at(5, 5) < 0);
+	assert(tabby_merkle_proof_bytes_at(5, 0) == 8 + 3 * 32);
+	assert(tabby_merkle_proof_bytes_at(5, 4) == 8 + 1 * 32);
+
+	for (int count = 1; count <= 33; ++count) {
+		const int proof_bytes = tabby_merkle_proof_bytes(count);
+		vector<char> mmessages(count * 16);
+		vector<const void *> mmessage_list(count);
+		vector<int> mbytes(count);
+		vector<char> mproofs(count * proof_bytes);
+		vector<char *> mproof_list(count);
+		char signature[96];
+
+		for (int jj = 0; jj < count; ++jj) {
+			mbytes[jj] = 1 + jj % 16;
+			for (int kk = 0; kk < mbytes[jj]; ++kk) {
+				mmessages[jj * 16 + kk] = (char)(count + jj * 3 + kk);
+			}
+			mmessage_list[jj] = &mmessages[jj * 16];
+			mproof_list[jj] = &mproofs[jj * proof_bytes];
+		}
+
+		assert(0 == tabby_merkle_sign(&s, count, &mmessage_list[0], &mbytes[0], signature, &mproof_list[0]));
+
+		// Verify the root once, then check each message against it
+		char root[64];
+		assert(0 == tabby_merkle_root(mmessage_list[0], mbytes[0], mproof_list[0], proof_bytes, root));
+		assert(0 == tabby_merkle_verify_root(root, public_key, signature));
+
+		for (int jj = 0; jj < count; ++jj) {
+			const int message_proof_bytes = tabby_merkle_proof_bytes_at(count, jj);
+			assert(message_proof_bytes >= 8 && message_proof_bytes <= proof_bytes);
+
+			char message_root[64];
+			assert(0 == tabby_merkle_root(mmessage_list[jj], mbytes[jj], mproof_list[jj], message_proof_bytes, message_root));
+			assert(0 == memcmp(root, message_root, 64));
+			assert(0 == tabby_merkle_verify(mmessage_list[jj], mbytes[jj], mproof_list[jj], message_proof_bytes, public_key, signature));
+
+			// Proofs with trailing or missing bytes are rejected
+			if (message_proof_bytes < proof_bytes) {
+				assert(0 != tabby_merkle_root(mmessage_list[jj], mbytes[jj], mproof_list[jj], message_proof_bytes + 1, message_root));
+			}
+			if (message_proof_bytes > 8) {
+				assert(0 != tabby_merkle_root(mmessage_list[jj], mbytes[jj], mproof_list[jj], message_proof_bytes - 1, message_root));
+			}
+
+			// A message does not verify with another message's proof
+			if (count > 1) {
+				const int other = (jj + 1) % count;
+				assert(0 != tabby_merkle_verify(mmessage_list[jj], mbytes[jj], mproof_list[other], tabby_merkle_proof_bytes_at(count, other), public_key, signature));
+			}
+
+			// Corrupted messages and proofs are rejected
+			char *message = &mmessages[jj * 16];
+			message[0] ^= 1;
+			assert(0 != tabby_merkle_verify(message, mbytes[jj], mproof_list[jj], message_proof_bytes, public_key, signature));
+			message[0] ^= 1;
+
+			char *proof = mproof_list[jj];
+			proof[message_proof_bytes - 1] ^= 1;
+			if (message_proof_bytes > 8) {
+				assert(0 != tabby_merkle_verify(message, mbytes[jj], proof, message_proof_bytes, public_key, signature));
+			}
+			proof[message_proof_bytes - 1] ^= 1;
+			proof[4] ^= 1;
+			assert(0 != tabby_merkle_verify(message, mbytes[jj], proof, message_proof_bytes, public_key, signature));
+			proof[4] ^= 1;
+		}
+
+		// Not valid as a plain signature of the root
+		assert(0 != tabby_verify(root, 64, public_key, signature));
+	}
+
+	{
+		static const int MERKLE_COUNT = 1024;
+
+		const int proof_bytes = tabby_merkle_proof_bytes(MERKLE_COUNT);
+		vector<char> mmessages(MERKLE_COUNT * 64);
+		vector<const void *> mmessage_list(MERKLE_COUNT);
+		vector<int> mbytes(MERKLE_COUNT, 64);
+		vector<char> mproofs(MERKLE_COUNT * proof_bytes);
+		vector<char *> mproof_list(MERKLE_COUNT);
+		char signature[96];
+
+		for (int jj = 0; jj < MERKLE_COUNT; ++jj) {
+			for (int kk = 0; kk < 64; ++kk) {
+				mmessages[jj * 64 + kk] = (char)(jj + kk);
+			}
+			mmessage_list[jj] = &mmessages[jj * 64];
+			mproof_list[jj] = &mproofs[jj * proof_bytes];
+		}
+
+		t0 = m_clock.usec();
+
+		assert(0 == tabby_merkle_sign(&s, MERKLE_COUNT, &mmessage_list[0], &mbytes[0], signature, &mproof_list[0]));
+
+		t1 = m_clock.usec();
+
+		const double wms = (t1 - t0) / MERKLE_COUNT;
+
+		char root[64];
+		assert(0 == tabby_merkle_root(mmessage_list[0], 64, mproof_list[0], proof_bytes, root));
+		assert(0 == tabby_merkle_verify_root(root, public_key, signature));
+
+		t0 = m_clock.usec();
+
+		for (int jj = 0; jj < MERKLE_COUNT; ++jj) {
+			char message_root[64];
+			assert(0 == tabby_merkle_root(mmessage_list[jj], 64, mproof_list[jj], proof_bytes, message_root));
+			assert(0 == memcmp(root, message_root, 64));
+		}
+
+		t1 = m_clock.usec();
+
+		const double wmv = (t1 - t0) / MERKLE_COUNT;
+
+		cout << "+ Tabby Merkle batch sign: `" << wms << "` avg usec per message" << endl;
+		cout << "+ Tabby Merkle batch check: `" << wmv << "` avg usec per message" << endl;
+	}
+
+	// Verified signature cache test:
+
+	tabby_verify_cache vcache;
+
+	assert(0 != tabby_verify_cache_gen(&vcache, 0));
+	assert(0 == tabby_verify_cache_gen(&vcache, 64));
+
+	vector<u32> tcm, tch;
+	double wcm = 0, wch = 0;
+
+	for (int ii = 0; ii < 1000; ++ii) {
+		char signature[96];
+		char message[64];
+		const int message_bytes = 64;
+
+		for (int jj = 0; jj < message_bytes; ++jj) {
+			message[jj] = (char)(ii * 5 + jj);
+		}
+
+		assert(0 == tabby_sign(&s, message, message_bytes, signature));
+
+		// Rejected signatures are not cached
+		signature[ii % 96] ^= 1;
+		assert(0 != tabby_verify_cached(&vcache, message, message_bytes, public_key, signature));
+		assert(0 != tabby_verify_cached(&vcache, message, message_bytes, public_key, signature));
+		signature[ii % 96] ^= 1;
 
 		t0 = m_clock.usec();
 		c0 = Clock::cycles();
 
-		assert(0 == tabby_client_handshake(&c, public_key, server_response, client_secret_key));
+		assert(0 == tabby_verify_cached(&vcache, message, message_bytes, public_key, signature));
 
 		c1 = Clock::cycles();
 		t1 = m_clock.usec();
 
-		tc.push_back(c1 - c0);
-		wc += t1 - t0;
+		tcm.push_back(c1 - c0);
+		wcm += t1 - t0;
 
-		assert(0 == memcmp(server_secret_key, client_secret_key, 32));
+		t0 = m_clock.usec();
+		c0 = Clock::cycles();
 
-		tabby_erase(server_secret_key, 32);
-		tabby_erase(client_secret_key, 32);
+		assert(0 == tabby_verify_cached(&vcache, message, message_bytes, public_key, signature));
+
+		c1 = Clock::cycles();
+		t1 = m_clock.usec();
+
+		tch.push_back(c1 - c0);
+		wch += t1 - t0;
+
+		// A hit does not match a different message or signature
+		message[ii % message_bytes] ^= 1;
+		assert(0 != tabby_verify_cached(&vcache, message, message_bytes, public_key, signature));
+		message[ii % message_bytes] ^= 1;
+		signature[64 + ii % 32] ^= 1;
+		assert(0 != tabby_verify_cached(&vcache, message, message_bytes, public_key, signature));
 	}
 
-	u32 mr = quick_select(&tr[0], (int)tr.size());
-	wr /= tr.size();
-	u32 ms = quick_select(&ts[0], (int)ts.size());
-	ws /= ts.size();
-	u32 mc = quick_select(&tc[0], (int)tc.size());
-	wc /= tc.size();
+	tabby_verify_cache_free(&vcache);
 
-	int cps = (int)(1000000.0 / ws);
+	u32 mcm = quick_select(&tcm[0], (int)tcm.size());
+	wcm /= tcm.size();
+	u32 mch = quick_select(&tch[0], (int)tch.size());
+	wch /= tch.size();
 
-	cout << "+ Tabby client rekey: `" << dec << mr << "` median cycles, `" << wr << "` avg usec" << endl;
-	cout << "+ Tabby server handshake: `" << dec << ms << "` median cycles, `" << ws << "` avg usec (`" << cps << "` connections/second)" << endl;
-	cout << "+ Tabby client handshake: `" << dec << mc << "` median cycles, `" << wc << "` avg usec" << endl;
+	cout << "+ Tabby cached verify miss: `" << dec << mcm << "` median cycles, `" << wcm << "` avg usec" << endl;
+	cout << "+ Tabby cached verify hit: `" << dec << mch << "` median cycles, `" << wch << "` avg usec" << endl;
+
+	// Verification key cache test:
+
+	{
+		const int KEY_CACHE_SIGNERS = 12;
+		tabby_server signers[KEY_CACHE_SIGNERS];
+		char signer_keys[KEY_CACHE_SIGNERS][64];
+
+		for (int ii = 0; ii < KEY_CACHE_SIGNERS; ++ii) {
+			assert(0 == tabby_server_gen(&signers[ii], 0, 0));
+			assert(0 == tabby_server_get_public_key(&signers[ii], signer_keys[ii]));
+		}
+
+		unsigned long long hits, builds;
+
+		// Room for eight public keys, so the cold ones evict each other
+		assert(0 != tabby_verify_key_cache_enable(1000));
+		assert(0 != tabby_verify_key_cache_stats(&hits, &builds));
+		assert(0 == tabby_verify_key_cache_enable(8 * (SNOWSHOE_PRECOMP_BYTES + 256)));
+		assert(0 != tabby_verify_key_cache_enable(100000));
+
+		vector<u32> tkc;
+		double wkc = 0;
+
+		for (int ii = 0; ii < 600; ++ii) {
+			// Mostly the first signer, with the others mixed in
+			const int signer = (ii % 4 == 3) ? 1 + (ii / 4) % (KEY_CACHE_SIGNERS - 1) : 0;
+
+			char signature[96];
+			char message[64];
+			const int message_bytes = 64;
+
+			for (int jj = 0; jj < message_bytes; ++jj) {
+				message[jj] = (char)(ii * 3 + jj);
+			}
+
+			assert(0 == tabby_sign(&signers[signer], message, message_bytes, signature));
+
+			unsigned long long hits0, builds0;
+			assert(0 == tabby_verify_key_cache_stats(&hits0, &builds0));
+
+			t0 = m_clock.usec();
+			c0 = Clock::cycles();
+
+			assert(0 == tabby_verify(message, message_bytes, signer_keys[signer], signature));
+
+			c1 = Clock::cycles();
+			t1 = m_clock.usec();
+
+			assert(0 == tabby_verify_key_cache_stats(&hits, &builds));
+
+			if (signer == 0) {
+				tkc.push_back(c1 - c0);
+				wkc += t1 - t0;
+
+				// Once it is hot, the first signer stays in the cache
+				if (ii >= 2) {
+					assert(hits == hits0 + 1 && builds == builds0);
+				}
+			}
+
+			// Cached tables still reject a bad signature or the wrong key
+			signature[ii % 96] ^= 1;
+			assert(0 != tabby_verify(message, message_bytes, signer_keys[signer], signature));
+			signature[ii % 96] ^= 1;
+			assert(0 != tabby_verify(message, message_bytes, signer_keys[(signer + 1) % KEY_CACHE_SIGNERS], signature));
+		}
+
+		// The cold signers did get tables, and pushed each other out
+		assert(0 == tabby_verify_key_cache_stats(&hits, &builds));
+		assert(builds > KEY_CACHE_SIGNERS);
+
+		tabby_verify_key_cache_disable();
+
+		for (int ii = 0; ii < KEY_CACHE_SIGNERS; ++ii) {
+			tabby_erase(&signers[ii], sizeof(signers[ii]));
+		}
+
+		u32 mkc = quick_select(&tkc[0], (int)tkc.size());
+		wkc /= tkc.size();
+
+		cout << "+ Tabby verify with key cache: `" << dec << mkc << "` median cycles, `" << wkc << "` avg usec (" << builds << " tables built)" << endl;
+	}
+
+	// Streaming signature test:
+
+	{
+		tabby_stream stream;
+		char signature[96];
+
+		// Signing needs a server object, and verifying can not sign
+		assert(0 != tabby_sign_init(&stream, 0));
+		assert(0 == tabby_verify_init(&stream, public_key));
+		assert(0 != tabby_sign_final(&stream, signature));
+
+		// Prehash signatures and tabby_sign() signatures do not mix
+		char message[300];
+		for (int jj = 0; jj < (int)sizeof(message); ++jj) {
+			message[jj] = (char)(jj * 7);
+		}
+
+		assert(0 == tabby_sign_init(&stream, &s));
+		assert(0 == tabby_stream_update(&stream, message, sizeof(message)));
+		assert(0 == tabby_sign_final(&stream, signature));
+
+		assert(0 != tabby_verify(message, sizeof(message), public_key, signature));
+
+		char plain_signature[96];
+		assert(0 == tabby_sign(&s, message, sizeof(message), plain_signature));
+		assert(0 == tabby_verify_init(&stream, public_key));
+		assert(0 == tabby_stream_update(&stream, message, sizeof(message)));
+		assert(0 != tabby_verify_final(&stream, plain_signature));
+
+		// Finishing erases the stream
+		assert(0 != tabby_stream_update(&stream, message, 1));
+		assert(0 != tabby_sign_final(&stream, signature));
+	}
+
+	vector<u32> tss, tsv;
+	double wss = 0, wsv = 0;
+
+	for (int ii = 0; ii < 1000; ++ii) {
+		tabby_stream stream;
+		char signature[96];
+		char message[1000];
+		const int message_bytes = 1 + ii;
+
+		for (int jj = 0; jj < message_bytes; ++jj) {
+			message[jj] = (char)(ii + jj);
+		}
+
+		// Sign in one piece and verify in pieces of varying size
+		t0 = m_clock.usec();
+		c0 = Clock::cycles();
+
+		assert(0 == tabby_sign_init(&stream, &s));
+		assert(0 == tabby_stream_update(&stream, message, message_bytes));
+		assert(0 == tabby_sign_final(&stream, signature));
+
+		c1 = Clock::cycles();
+		t1 = m_clock.usec();
+
+		tss.push_back(c1 - c0);
+		wss += t1 - t0;
+
+		t0 = m_clock.usec();
+		c0 = Clock::cycles();
+
+		assert(0 == tabby_verify_init(&stream, public_key));
+		for (int offset = 0, piece = 1; offset < message_bytes; offset += piece, piece += 7) {
+			const int remaining = message_bytes - offset;
+			assert(0 == tabby_stream_update(&stream, message + offset, piece < remaining ? piece : remaining));
+		}
+		assert(0 == tabby_verify_final(&stream, signature));
+
+		c1 = Clock::cycles();
+		t1 = m_clock.usec();
+
+		tsv.push_back(c1 - c0);
+		wsv += t1 - t0;
+
+		// Corrupted messages and signatures are rejected
+		message[ii % message_bytes] ^= 1;
+		assert(0 == tabby_verify_init(&stream, public_key));
+		assert(0 == tabby_stream_update(&stream, message, message_bytes));
+		assert(0 != tabby_verify_final(&stream, signature));
+		message[ii % message_bytes] ^= 1;
+		signature[ii % 96] ^= 1;
+		assert(0 == tabby_verify_init(&stream, public_key));
+		assert(0 == tabby_stream_update(&stream, message, message_bytes));
+		assert(0 != tabby_verify_final(&stream, signature));
+	}
+
+	u32 mss = quick_select(&tss[0], (int)tss.size());
+	wss /= tss.size();
+	u32 msv = quick_select(&tsv[0], (int)tsv.size());
+	wsv /= tsv.size();
+
+	cout << "+ Tabby streaming sign: `" << dec << mss << "` median cycles, `" << wss << "` avg usec" << endl;
+	cout << "+ Tabby streaming verify: `" << dec << msv << "` median cycles, `" << wsv << "` avg usec" << endl;
+
+	// File signature test:
+
+	{
+		const char *path = "tabby_test_file.tmp";
+		char signature[96];
+
+		// Missing files are rejected
+		remove(path);
+		assert(0 != tabby_sign_file(&s, path, signature));
+
+		// Empty files can be signed
+		FILE *fp = fopen(path, "wb");
+		assert(fp != 0);
+		fclose(fp);
+
+		assert(0 == tabby_sign_file(&s, path, signature));
+		assert(0 == tabby_verify_file(path, public_key, signature));
+
+		// Write a file that is a few leaves long, with a partial last leaf
+		const int file_bytes = 3 * 1024 * 1024 + 12345;
+		vector<char> contents(file_bytes);
+		for (int jj = 0; jj < file_bytes; ++jj) {
+			contents[jj] = (char)(jj * 13 + (jj >> 16));
+		}
+
+		fp = fopen(path, "wb");
+		assert(fp != 0);
+		assert(file_bytes == (int)fwrite(&contents[0], 1, file_bytes, fp));
+		fclose(fp);
+
+		t0 = m_clock.usec();
+
+		assert(0 == tabby_sign_file(&s, path, signature));
+
+		t1 = m_clock.usec();
+
+		const double wfs = t1 - t0;
+
+		t0 = m_clock.usec();
+
+		assert(0 == tabby_verify_file(path, public_key, signature));
+
+		t1 = m_clock.usec();
+
+		const double wfv = t1 - t0;
+
+		// Not valid for the file contents signed any other way
+		assert(0 != tabby_verify(&contents[0], file_bytes, public_key, signature));
+
+		// Corrupted signatures and files are rejected
+		signature[5] ^= 1;
+		assert(0 != tabby_verify_file(path, public_key, signature));
+		signature[5] ^= 1;
+
+		fp = fopen(path, "r+b");
+		assert(fp != 0);
+		fseek(fp, 2 * 1024 * 1024 + 7, SEEK_SET);
+		fputc(contents[2 * 1024 * 1024 + 7] ^ 1, fp);
+		fclose(fp);
+
+		assert(0 != tabby_verify_file(path, public_key, signature));
+
+		remove(path);
+
+		cout << "+ Tabby sign file: `" << (file_bytes / wfs) << "` MB/s" << endl;
+		cout << "+ Tabby verify file: `" << (file_bytes / wfv) << "` MB/s" << endl;
+	}
+
+	// Signed log test:
+
+	{
+		const char *path = "tabby_test_log.tmp";
+		tabby_log log;
+		unsigned long long signed_bytes = 0;
+
+		remove(path);
+		assert(0 != tabby_log_verify(path, public_key, &signed_bytes));
+
+		// Records of varying length, with a checkpoint every 4 KB
+		assert(0 != tabby_log_open(&log, &s, path, -1));
+		assert(0 == tabby_log_open(&log, &s, path, 4096));
+
+		char record[300];
+		for (int ii = 0; ii < 2000; ++ii) {
+			const int record_bytes = ii % (int)sizeof(record);
+			for (int jj = 0; jj < record_bytes; ++jj) {
+				record[jj] = (char)(ii + jj * 3);
+			}
+			assert(0 == tabby_log_append(&log, record, record_bytes));
+		}
+
+		assert(0 == tabby_log_close(&log));
+
+		t0 = m_clock.usec();
+
+		assert(0 == tabby_log_verify(path, public_key, &signed_bytes));
+
+		t1 = m_clock.usec();
+
+		const double wlv = t1 - t0;
+
+		FILE *fp = fopen(path, "rb");
+		assert(fp != 0);
+		fseek(fp, 0, SEEK_END);
+		const long log_bytes = ftell(fp);
+		fclose(fp);
+
+		assert(signed_bytes == (unsigned long long)log_bytes);
+
+		// Appending picks up the chain, and unsigned records are not counted
+		assert(0 == tabby_log_open(&log, &s, path, 4096));
+		assert(0 == tabby_log_append(&log, record, 100));
+		assert(0 == tabby_log_checkpoint(&log));
+		assert(0 == tabby_log_append(&log, record, 100));
+		assert(0 == tabby_log_close(&log));
+
+		assert(0 == tabby_log_verify(path, public_key, &signed_bytes));
+		assert(signed_bytes == (unsigned long long)log_bytes + 2 * (4 + 100 + 4 + 168));
+
+		// Wrong key is rejected
+		assert(0 != tabby_log_verify(path, public_key2, &signed_bytes));
+
+		// A record cut off by a crash is rejected, and reopening drops it
+		fp = fopen(path, "ab");
+		assert(fp != 0);
+		const unsigned char cut_header[4] = { 100, 0, 0, 0 };
+		fwrite(cut_header, 1, sizeof(cut_header), fp);
+		fwrite(record, 1, 10, fp);
+		fclose(fp);
+
+		assert(0 != tabby_log_verify(path, public_key, &signed_bytes));
+
+		assert(0 == tabby_log_open(&log, &s, path, 4096));
+		assert(0 == tabby_log_append(&log, record, 100));
+		assert(0 == tabby_log_close(&log));
+
+		assert(0 == tabby_log_verify(path, public_key, &signed_bytes));
+		assert(signed_bytes == (unsigned long long)log_bytes + 3 * (4 + 100 + 4 + 168));
+
+		// A changed record is rejected
+		fp = fopen(path, "r+b");
+		assert(fp != 0);
+		fseek(fp, log_bytes / 2, SEEK_SET);
+		const int original = fgetc(fp);
+		fseek(fp, log_bytes / 2, SEEK_SET);
+		fputc(original ^ 1, fp);
+		fclose(fp);
+
+		assert(0 != tabby_log_verify(path, public_key, &signed_bytes));
+
+		// A truncated entry is rejected
+		fp = fopen(path, "ab");
+		assert(fp != 0);
+		fputc(1, fp);
+		fclose(fp);
+
+		assert(0 != tabby_log_verify(path, public_key, &signed_bytes));
+
+		remove(path);
+
+		cout << "+ Tabby verify signed log: `" << (log_bytes / wlv) << "` MB/s" << endl;
+	}
+
+	// Handshake test:
+
+	cout << "Generating a 256-bit entropy client key..." << endl;
+
+	t0 = m_clock.usec();
+	c0 = Clock::cycles();
+
+	tabby_client c;
+	char client_request[96];
+
+	assert(0 == tabby_client_gen(&c, 0, 0, client_request));
+
+	c1 = Clock::cycles();
+	t1 = m_clock.usec();
+
+	cout << "+ Generated a client key in " << (c1 - c0) << " cycles, " << (t1 - t0) << " usec (one sample)" << endl;
+
+	vector<u32> tr, ts, tc;
+	double wr = 0, ws = 0, wc = 0;
+
+	for (int ii = 0; ii < 10000; ++ii) {
+		if (ii == 1000) {
+			t0 = m_clock.usec();
+			c0 = Clock::cycles();
+
+			tabby_server_rekey(&s, 0, 0);
+
+			c1 = Clock::cycles();
+			t1 = m_clock.usec();
+
+			cout << "+ Periodic server rekey in " << (c1 - c0) << " cycles, " << (t1 - t0) << " usec" << endl;
+		}
+
+		t0 = m_clock.usec();
+		c0 = Clock::cycles();
+
+		assert(0 == tabby_client_rekey(&c, &c, 0, 0, client_request));
+
+		c1 = Clock::cycles();
+		t1 = m_clock.usec();
+
+		tr.push_back(c1 - c0);
+		wr += t1 - t0;
+
+		char server_response[128];
+		char server_secret_key[32];
+
+		t0 = m_clock.usec();
+		c0 = Clock::cycles();
+
+		assert(0 == tabby_server_handshake(&s, client_request, server_response, server_secret_key));
+
+		c1 = Clock::cycles();
+		t1 = m_clock.usec();
+
+		ts.push_back(c1 - c0);
+		ws += t1 - t0;
+
+		char client_secret_key[32];
+
+		t0 = m_clock.usec();
+		c0 = Clock::cycles();
+
+		assert(0 == tabby_client_handshake(&c, public_key, server_response, client_secret_key));
+
+		c1 = Clock::cycles();
+		t1 = m_clock.usec();
+
+		tc.push_back(c1 - c0);
+		wc += t1 - t0;
+
+		assert(0 == memcmp(server_secret_key, client_secret_key, 32));
+
+		tabby_erase(server_secret_key, 32);
+		tabby_erase(client_secret_key, 32);
+	}
+
+	u32 mr = quick_select(&tr[0], (int)tr.size());
+	wr /= tr.size();
+	u32 ms = quick_select(&ts[0], (int)ts.size());
+	ws /= ts.size();
+	u32 mc = quick_select(&tc[0], (int)tc.size());
+	wc /= tc.size();
+
+	int cps = (int)(1000000.0 / ws);
+
+	cout << "+ Tabby client rekey: `" << dec << mr << "` median cycles, `" << wr << "` avg usec" << endl;
+	cout << "+ Tabby server handshake: `" << dec << ms << "` median cycles, `" << ws << "` avg usec (`" << cps << "` connections/second)" << endl;
+	cout << "+ Tabby client handshake: `" << dec << mc << "` median cycles, `" << wc << "` avg usec" << endl;
+
+	// Precomputed server key test:
+
+	tabby_server_key sk;
+
+	{
+		char bad_key[64];
+		memset(bad_key, 0xff, 64);
+		assert(0 != tabby_server_key_gen(&sk, bad_key));
+	}
+
+	t0 = m_clock.usec();
+	c0 = Clock::cycles();
+
+	assert(0 == tabby_server_key_gen(&sk, public_key));
+
+	c1 = Clock::cycles();
+	t1 = m_clock.usec();
+
+	cout << "+ Precomputed server key in " << dec << (c1 - c0) << " cycles, " << (t1 - t0) << " usec (one sample)" << endl;
+
+	vector<u32> tpk;
+	double wpk = 0;
+
+	for (int ii = 0; ii < 1000; ++ii) {
+		assert(0 == tabby_client_rekey(&c, &c, 0, 0, client_request));
+
+		char server_response[128];
+		char server_secret_key[32];
+
+		assert(0 == tabby_server_handshake(&s, client_request, server_response, server_secret_key));
+
+		char client_secret_key[32];
+
+		t0 = m_clock.usec();
+		c0 = Clock::cycles();
+
+		assert(0 == tabby_client_handshake_key(&c, &sk, server_response, client_secret_key));
+
+		c1 = Clock::cycles();
+		t1 = m_clock.usec();
+
+		tpk.push_back(c1 - c0);
+		wpk += t1 - t0;
+
+		assert(0 == memcmp(server_secret_key, client_secret_key, 32));
+
+		// A corrupted response is still rejected
+		server_response[100] ^= 1;
+		assert(0 != tabby_client_handshake_key(&c, &sk, server_response, client_secret_key));
+	}
+
+	tabby_server_key_free(&sk);
+
+	u32 mpk = quick_select(&tpk[0], (int)tpk.size());
+	wpk /= tpk.size();
+
+	cout << "+ Tabby client handshake with precomputed server key: `" << dec << mpk << "` median cycles, `" << wpk << "` avg usec" << endl;
+
+	// Client key pool test:
+
+	static const int CLIENT_POOL_COUNT = 64;
+
+	tabby_client_pool cp;
+
+	assert(0 != tabby_client_pool_gen(&cp, 0, 0, 0));
+
+	t0 = m_clock.usec();
+	c0 = Clock::cycles();
+
+	assert(0 == tabby_client_pool_gen(&cp, CLIENT_POOL_COUNT, 0, 0));
+
+	c1 = Clock::cycles();
+	t1 = m_clock.usec();
+
+	cout << "+ Filled client key pool of " << dec << CLIENT_POOL_COUNT << " in " << (c1 - c0) << " cycles, " << (t1 - t0) << " usec" << endl;
+
+	assert(CLIENT_POOL_COUNT == tabby_client_pool_size(&cp));
+
+	vector<u32> tcp;
+	double wcp = 0;
+
+	for (int jj = 0; jj < 4; ++jj) {
+		for (int ii = 0; ii < CLIENT_POOL_COUNT; ++ii) {
+			tabby_client pc;
+
+			t0 = m_clock.usec();
+			c0 = Clock::cycles();
+
+			assert(0 == tabby_client_pool_pop(&cp, &pc, client_request));
+
+			c1 = Clock::cycles();
+			t1 = m_clock.usec();
+
+			tcp.push_back(c1 - c0);
+			wcp += t1 - t0;
+
+			char server_response[128];
+			char server_secret_key[32];
+			char client_secret_key[32];
+
+			assert(0 == tabby_server_handshake(&s, client_request, server_response, server_secret_key));
+			assert(0 == tabby_client_handshake(&pc, public_key, server_response, client_secret_key));
+			assert(0 == memcmp(server_secret_key, client_secret_key, 32));
+
+			tabby_erase(&pc, sizeof(pc));
+		}
+
+		// Popping from an empty pool fails until it is refilled
+		tabby_client pc;
+		assert(0 == tabby_client_pool_size(&cp));
+		assert(0 != tabby_client_pool_pop(&cp, &pc, client_request));
+		assert(0 == tabby_client_pool_fill(&cp));
+		assert(CLIENT_POOL_COUNT == tabby_client_pool_size(&cp));
+	}
+
+	tabby_client_pool_free(&cp);
+
+	u32 mcp = quick_select(&tcp[0], (int)tcp.size());
+	wcp /= tcp.size();
+
+	cout << "+ Tabby client connect from key pool: `" << dec << mcp << "` median cycles, `" << wcp << "` avg usec" << endl;
+
+	// Batch handshake test:
+
+	static const int BATCH_COUNT = 64;
+
+	vector<tabby_client> bc(BATCH_COUNT);
+	vector<char> batch_requests(BATCH_COUNT * 96);
+	vector<char> batch_responses(BATCH_COUNT * 128);
+	vector<char> batch_keys(BATCH_COUNT * 32);
+	vector<int> batch_results(BATCH_COUNT);
+
+	for (int ii = 0; ii < BATCH_COUNT; ++ii) {
+		assert(0 == tabby_client_gen(&bc[ii], 0, 0, &batch_requests[ii * 96]));
+	}
+
+	vector<u32> tb;
+	double wb = 0;
+
+	for (int ii = 0; ii < 200; ++ii) {
+		for (int jj = 0; jj < BATCH_COUNT; ++jj) {
+			assert(0 == tabby_client_rekey(&bc[jj], &bc[jj], 0, 0, &batch_requests[jj * 96]));
+		}
+
+		// Corrupt one of the requests every so often
+		const int bad = (ii % 4 == 0) ? (ii % BATCH_COUNT) : -1;
+		if (bad >= 0) {
+			batch_requests[bad * 96 + 7] ^= 1;
+		}
+
+		t0 = m_clock.usec();
+		c0 = Clock::cycles();
+
+		const int batch_result = tabby_server_handshake_batch(&s, BATCH_COUNT, &batch_requests[0], &batch_responses[0], &batch_keys[0], &batch_results[0]);
+
+		c1 = Clock::cycles();
+		t1 = m_clock.usec();
+
+		tb.push_back((c1 - c0) / BATCH_COUNT);
+		wb += (t1 - t0) / BATCH_COUNT;
+
+		assert((bad >= 0) == (batch_result != 0));
+
+		for (int jj = 0; jj < BATCH_COUNT; ++jj) {
+			if (jj == bad) {
+				assert(batch_results[jj] != 0);
+				continue;
+			}
+
+			char client_secret_key[32];
+
+			assert(batch_results[jj] == 0);
+			assert(0 == tabby_client_handshake(&bc[jj], public_key, &batch_responses[jj * 128], client_secret_key));
+			assert(0 == memcmp(&batch_keys[jj * 32], client_secret_key, 32));
+
+			tabby_erase(client_secret_key, 32);
+		}
+	}
+
+	u32 mb = quick_select(&tb[0], (int)tb.size());
+	wb /= tb.size();
+
+	cout << "+ Tabby server batch handshake: `" << dec << mb << "` median cycles, `" << wb << "` avg usec per handshake" << endl;
+
+	// Client batch handshake test:
+
+	vector<char> batch_server_keys(BATCH_COUNT * 64);
+	vector<char> batch_client_keys(BATCH_COUNT * 32);
+
+	for (int ii = 0; ii < BATCH_COUNT; ++ii) {
+		memcpy(&batch_server_keys[ii * 64], public_key, 64);
+	}
+
+	vector<u32> tcb;
+	double wcb = 0;
+
+	for (int ii = 0; ii < 200; ++ii) {
+		for (int jj = 0; jj < BATCH_COUNT; ++jj) {
+			assert(0 == tabby_client_rekey(&bc[jj], &bc[jj], 0, 0, &batch_requests[jj * 96]));
+		}
+
+		assert(0 == tabby_server_handshake_batch(&s, BATCH_COUNT, &batch_requests[0], &batch_responses[0], &batch_keys[0], &batch_results[0]));
+
+		// Corrupt the proof or ephemeral key of one of the responses every so often
+		const int bad = (ii % 4 == 0) ? (ii % BATCH_COUNT) : -1;
+		if (bad >= 0) {
+			batch_responses[bad * 128 + ((ii & 4) ? 100 : 5)] ^= 1;
+		}
+
+		t0 = m_clock.usec();
+		c0 = Clock::cycles();
+
+		const int batch_result = tabby_client_handshake_batch(BATCH_COUNT, &bc[0], &batch_server_keys[0], &batch_responses[0], &batch_client_keys[0], &batch_results[0]);
+
+		c1 = Clock::cycles();
+		t1 = m_clock.usec();
+
+		tcb.push_back((c1 - c0) / BATCH_COUNT);
+		wcb += (t1 - t0) / BATCH_COUNT;
+
+		assert((bad >= 0) == (batch_result != 0));
+
+		for (int jj = 0; jj < BATCH_COUNT; ++jj) {
+			if (jj == bad) {
+				assert(batch_results[jj] != 0);
+				continue;
+			}
+
+			assert(batch_results[jj] == 0);
+			assert(0 == memcmp(&batch_keys[jj * 32], &batch_client_keys[jj * 32], 32));
+		}
+	}
+
+	u32 mcb = quick_select(&tcb[0], (int)tcb.size());
+	wcb /= tcb.size();
+
+	cout << "+ Tabby client batch handshake: `" << dec << mcb << "` median cycles, `" << wcb << "` avg usec per handshake" << endl;
+
+	tabby_erase(&batch_client_keys[0], batch_client_keys.size());
+
+	tabby_erase(&batch_keys[0], batch_keys.size());
+
+	// Worker handshake test:
+
+	static const int WORKER_COUNT = 4;
+
+	tabby_worker workers[WORKER_COUNT];
+
+	for (int ii = 0; ii < WORKER_COUNT; ++ii) {
+		assert(0 == tabby_worker_gen(&workers[ii], &s, &ii, sizeof(ii)));
+	}
+
+	vector<u32> tw;
+	double ww = 0;
+
+	for (int ii = 0; ii < 1000; ++ii) {
+		tabby_worker *w = &workers[ii % WORKER_COUNT];
+
+		assert(0 == tabby_client_rekey(&c, &c, 0, 0, client_request));
+
+		char server_response[128];
+		char server_secret_key[32];
+
+		t0 = m_clock.usec();
+		c0 = Clock::cycles();
+
+		assert(0 == tabby_worker_handshake(w, client_request, server_response, server_secret_key));
+
+		c1 = Clock::cycles();
+		t1 = m_clock.usec();
+
+		tw.push_back(c1 - c0);
+		ww += t1 - t0;
+
+		char client_secret_key[32];
+
+		assert(0 == tabby_client_handshake(&c, public_key, server_response, client_secret_key));
+		assert(0 == memcmp(server_secret_key, client_secret_key, 32));
+
+		tabby_erase(server_secret_key, 32);
+		tabby_erase(client_secret_key, 32);
+	}
+
+	// Workers should also accept batches and reject invalid requests
+	for (int jj = 0; jj < BATCH_COUNT; ++jj) {
+		assert(0 == tabby_client_rekey(&bc[jj], &bc[jj], 0, 0, &batch_requests[jj * 96]));
+	}
+	batch_requests[3 * 96 + 11] ^= 1;
+
+	assert(0 != tabby_worker_handshake_batch(&workers[1], BATCH_COUNT, &batch_requests[0], &batch_responses[0], &batch_keys[0], &batch_results[0]));
+
+	for (int jj = 0; jj < BATCH_COUNT; ++jj) {
+		if (jj == 3) {
+			assert(batch_results[jj] != 0);
+			continue;
+		}
+
+		char client_secret_key[32];
+
+		assert(batch_results[jj] == 0);
+		assert(0 == tabby_client_handshake(&bc[jj], public_key, &batch_responses[jj * 128], client_secret_key));
+		assert(0 == memcmp(&batch_keys[jj * 32], client_secret_key, 32));
+	}
+
+	u32 mw = quick_select(&tw[0], (int)tw.size());
+	ww /= tw.size();
+
+	cout << "+ Tabby worker handshake: `" << dec << mw << "` median cycles, `" << ww << "` avg usec" << endl;
+
+	// Background rekey test:
+
+	assert(0 == tabby_server_rekey_start(&s, 1));
+	assert(0 != tabby_server_rekey_start(&s, 1));
+
+	int ephemeral_changes = 0;
+	char last_ephemeral[64] = {0};
+
+	for (int ii = 0; ii < 2000; ++ii) {
+		assert(0 == tabby_client_rekey(&c, &c, 0, 0, client_request));
+
+		char server_response[128];
+		char server_secret_key[32];
+
+		assert(0 == tabby_worker_handshake(&workers[ii % WORKER_COUNT], client_request, server_response, server_secret_key));
+
+		char client_secret_key[32];
+
+		assert(0 == tabby_client_handshake(&c, public_key, server_response, client_secret_key));
+		assert(0 == memcmp(server_secret_key, client_secret_key, 32));
+
+		if (0 != memcmp(last_ephemeral, server_response, 64)) {
+			memcpy(last_ephemeral, server_response, 64);
+			++ephemeral_changes;
+		}
+	}
+
+	assert(0 == tabby_server_rekey_stop(&s));
+	assert(0 == tabby_server_rekey_stop(&s));
+
+	// The rekey thread should have published new keys without any help
+	assert(ephemeral_changes > 2);
+
+	cout << "+ Background rekey thread published " << ephemeral_changes << " ephemeral keys during 2000 handshakes" << endl;
+
+	// Replay cache test:
+
+	assert(0 != tabby_server_cache_enable(&s, (1 << 22) + 1));
+	assert(0 == tabby_server_cache_enable(&s, 1024));
+
+	vector<u32> tm, th;
+	double wm = 0, wh = 0;
+
+	for (int ii = 0; ii < 1000; ++ii) {
+		assert(0 == tabby_client_rekey(&c, &c, 0, 0, client_request));
+
+		char server_response[128], server_response2[128];
+		char server_secret_key[32], server_secret_key2[32];
+
+		t0 = m_clock.usec();
+		c0 = Clock::cycles();
+
+		assert(0 == tabby_server_handshake(&s, client_request, server_response, server_secret_key));
+
+		c1 = Clock::cycles();
+		t1 = m_clock.usec();
+
+		tm.push_back(c1 - c0);
+		wm += t1 - t0;
+
+		// Retransmitted request should get the same response
+		t0 = m_clock.usec();
+		c0 = Clock::cycles();
+
+		assert(0 == tabby_worker_handshake(&workers[ii % WORKER_COUNT], client_request, server_response2, server_secret_key2));
+
+		c1 = Clock::cycles();
+		t1 = m_clock.usec();
+
+		th.push_back(c1 - c0);
+		wh += t1 - t0;
+
+		assert(0 == memcmp(server_response, server_response2, 128));
+		assert(0 == memcmp(server_secret_key, server_secret_key2, 32));
+
+		char client_secret_key[32];
+
+		assert(0 == tabby_client_handshake(&c, public_key, server_response2, client_secret_key));
+		assert(0 == memcmp(server_secret_key, client_secret_key, 32));
+	}
+
+	// After a rekey the cached keys are gone, so a new response is made
+	{
+		char server_response[128], server_response2[128];
+		char server_secret_key[32], server_secret_key2[32];
+
+		assert(0 == tabby_server_handshake(&s, client_request, server_response, server_secret_key));
+		assert(0 == tabby_server_rekey(&s, 0, 0));
+		assert(0 == tabby_server_handshake(&s, client_request, server_response2, server_secret_key2));
+
+		assert(0 != memcmp(server_response, server_response2, 64));
+		assert(0 != memcmp(server_secret_key, server_secret_key2, 32));
+	}
+
+	// A request repeated within one batch gets the same response each time
+	{
+		char requests[3 * 96], responses[3 * 128], keys[3 * 32];
+		int results[3];
+
+		assert(0 == tabby_client_rekey(&c, &c, 0, 0, client_request));
+
+		memcpy(requests, client_request, 96);
+		memcpy(requests + 96, &batch_requests[0], 96);
+		memcpy(requests + 2 * 96, client_request, 96);
+
+		assert(0 == tabby_server_handshake_batch(&s, 3, requests, responses, keys, results));
+
+		assert(0 == memcmp(responses, responses + 2 * 128, 128));
+		assert(0 == memcmp(keys, keys + 2 * 32, 32));
+
+		char client_secret_key[32];
+
+		assert(0 == tabby_client_handshake(&c, public_key, responses + 2 * 128, client_secret_key));
+		assert(0 == memcmp(keys, client_secret_key, 32));
+	}
+
+	assert(0 == tabby_server_cache_free(&s));
+
+	u32 mm = quick_select(&tm[0], (int)tm.size());
+	wm /= tm.size();
+	u32 mh = quick_select(&th[0], (int)th.size());
+	wh /= th.size();
+
+	cout << "+ Tabby server handshake with replay cache (miss): `" << dec << mm << "` median cycles, `" << wm << "` avg usec" << endl;
+	cout << "+ Tabby server handshake with replay cache (hit): `" << dec << mh << "` median cycles, `" << wh << "` avg usec" << endl;
+
+	// Ephemeral key pool test:
+
+	assert(0 == tabby_server_pool_enable(&s, 8, 3));
+	assert(0 != tabby_server_pool_enable(&s, 8, 3));
+
+	// Cookies are not tied to the pooled keys, so rotations keep them valid
+	const unsigned char pool_address[6] = { 10, 0, 0, 2, 0x1f, 0x90 };
+	char pool_request[96], pool_cookie[16];
+
+	memcpy(pool_request, client_request, 96);
+	assert(0 == tabby_server_cookie(&s, pool_address, sizeof(pool_address), pool_request, pool_cookie));
+
+	{
+		char ephemeral[64], last[64];
+		int changes = 0;
+
+		// Handshakes rotate the key every 3 handshakes
+		for (int ii = 0; ii < 12; ++ii) {
+			assert(0 == tabby_client_rekey(&c, &c, 0, 0, client_request));
+
+			char server_response[128];
+			char server_secret_key[32];
+
+			assert(0 == tabby_worker_handshake(&workers[ii % WORKER_COUNT], client_request, server_response, server_secret_key));
+
+			char client_secret_key[32];
+
+			assert(0 == tabby_client_handshake(&c, public_key, server_response, client_secret_key));
+			assert(0 == memcmp(server_secret_key, client_secret_key, 32));
+
+			memcpy(ephemeral, server_response, 64);
+			if (ii > 0 && 0 != memcmp(last, ephemeral, 64)) {
+				++changes;
+			}
+			memcpy(last, ephemeral, 64);
+		}
+
+		assert(changes == 3);
+	}
+
+	// Rotate until the pool runs dry
+	int rotations = 0;
+	while (0 == tabby_server_rotate(&s)) {
+		++rotations;
+	}
+	assert(rotations == 4);
+
+	assert(0 == tabby_server_cookie_check(&s, pool_address, sizeof(pool_address), pool_request, pool_cookie));
+
+	vector<u32> tp, tg;
+	double wp = 0, wg = 0;
+
+	for (int ii = 0; ii < 100; ++ii) {
+		assert(0 == tabby_server_pool_fill(&s, 0, 0));
+
+		t0 = m_clock.usec();
+		c0 = Clock::cycles();
+
+		assert(0 == tabby_server_rotate(&s));
+
+		c1 = Clock::cycles();
+		t1 = m_clock.usec();
+
+		tp.push_back(c1 - c0);
+		wp += t1 - t0;
+
+		t0 = m_clock.usec();
+		c0 = Clock::cycles();
+
+		assert(0 == tabby_server_rekey(&s, 0, 0));
+
+		c1 = Clock::cycles();
+		t1 = m_clock.usec();
+
+		tg.push_back(c1 - c0);
+		wg += t1 - t0;
+	}
+
+	// Keys from the pool still work
+	{
+		assert(0 == tabby_server_rotate(&s));
+		assert(0 == tabby_client_rekey(&c, &c, 0, 0, client_request));
+
+		char server_response[128];
+		char server_secret_key[32];
+
+		assert(0 == tabby_server_handshake(&s, client_request, server_response, server_secret_key));
+
+		char client_secret_key[32];
+
+		assert(0 == tabby_client_handshake(&c, public_key, server_response, client_secret_key));
+		assert(0 == memcmp(server_secret_key, client_secret_key, 32));
+	}
+
+	assert(0 == tabby_server_pool_free(&s));
+	assert(0 != tabby_server_rotate(&s));
+
+	u32 mp = quick_select(&tp[0], (int)tp.size());
+	wp /= tp.size();
+	u32 mg = quick_select(&tg[0], (int)tg.size());
+	wg /= tg.size();
+
+	cout << "+ Tabby server rotate from pool: `" << dec << mp << "` median cycles, `" << wp << "` avg usec" << endl;
+	cout << "+ Tabby server rekey without pool: `" << dec << mg << "` median cycles, `" << wg << "` avg usec" << endl;
+
+	// Cookie test:
+
+	const unsigned char address[6] = { 127, 0, 0, 1, 0x1f, 0x90 };
+	const unsigned char address2[6] = { 127, 0, 0, 2, 0x1f, 0x90 };
+
+	vector<u32> tk, tv;
+	double wk = 0, wv = 0;
+
+	for (int ii = 0; ii < 10000; ++ii) {
+		assert(0 == tabby_client_rekey(&c, &c, 0, 0, client_request));
+
+		char cookie[16];
+
+		t0 = m_clock.usec();
+		c0 = Clock::cycles();
+
+		assert(0 == tabby_server_cookie(&s, address, sizeof(address), client_request, cookie));
+
+		c1 = Clock::cycles();
+		t1 = m_clock.usec();
+
+		tk.push_back(c1 - c0);
+		wk += t1 - t0;
+
+		t0 = m_clock.usec();
+		c0 = Clock::cycles();
+
+		assert(0 == tabby_server_cookie_check(&s, address, sizeof(address), client_request, cookie));
+
+		c1 = Clock::cycles();
+		t1 = m_clock.usec();
+
+		tv.push_back(c1 - c0);
+		wv += t1 - t0;
+
+		// Cookie should not work from another address
+		assert(0 != tabby_server_cookie_check(&s, address2, sizeof(address2), client_request, cookie));
+
+		// Or with a corrupted cookie
+		cookie[ii % 16] ^= 1;
+		assert(0 != tabby_server_cookie_check(&s, address, sizeof(address), client_request, cookie));
+	}
+
+	// Cookies survive one rekey but not two
+	{
+		char cookie[16];
+
+		assert(0 == tabby_server_cookie(&s, address, sizeof(address), client_request, cookie));
+		assert(0 == tabby_server_rekey(&s, 0, 0));
+		assert(0 == tabby_server_cookie_check(&s, address, sizeof(address), client_request, cookie));
+		assert(0 == tabby_server_rekey(&s, 0, 0));
+		assert(0 != tabby_server_cookie_check(&s, address, sizeof(address), client_request, cookie));
+	}
+
+	u32 mk = quick_select(&tk[0], (int)tk.size());
+	wk /= tk.size();
+	u32 mv = quick_select(&tv[0], (int)tv.size());
+	wv /= tv.size();
+
+	cout << "+ Tabby server cookie: `" << dec << mk << "` median cycles, `" << wk << "` avg usec" << endl;
+	cout << "+ Tabby server cookie check: `" << dec << mv << "` median cycles, `" << wv << "` avg usec" << endl;
+
+	// Session resumption test:
+
+	vector<u32> tt, tu, tq;
+	double wt = 0, wu = 0, wq = 0;
+
+	for (int ii = 0; ii < 10000; ++ii) {
+		char server_response[128];
+		char server_secret_key[32], client_secret_key[32];
+
+		assert(0 == tabby_client_rekey(&c, &c, 0, 0, client_request));
+		assert(0 == tabby_server_handshake(&s, client_request, server_response, server_secret_key));
+		assert(0 == tabby_client_handshake(&c, public_key, server_response, client_secret_key));
+
+		char ticket[48];
+
+		t0 = m_clock.usec();
+		c0 = Clock::cycles();
+
+		assert(0 == tabby_server_ticket(&s, server_secret_key, ticket));
+
+		c1 = Clock::cycles();
+		t1 = m_clock.usec();
+
+		tt.push_back(c1 - c0);
+		wt += t1 - t0;
+
+		char resume_request[80];
+		char resume_response[64];
+		char server_resume_key[32], client_resume_key[32];
+
+		assert(0 == tabby_client_resume(&c, ticket, resume_request));
+
+		t0 = m_clock.usec();
+		c0 = Clock::cycles();
+
+		assert(0 == tabby_server_resume(&s, resume_request, resume_response, server_resume_key));
+
+		c1 = Clock::cycles();
+		t1 = m_clock.usec();
+
+		tu.push_back(c1 - c0);
+		wu += t1 - t0;
+
+		t0 = m_clock.usec();
+		c0 = Clock::cycles();
+
+		assert(0 == tabby_client_resume_handshake(&c, client_secret_key, resume_response, client_resume_key));
+
+		c1 = Clock::cycles();
+		t1 = m_clock.usec();
+
+		tq.push_back(c1 - c0);
+		wq += t1 - t0;
+
+		assert(0 == memcmp(server_resume_key, client_resume_key, 32));
+		assert(0 != memcmp(server_resume_key, server_secret_key, 32));
+
+		// Workers should derive a different key for the same request
+		assert(0 == tabby_worker_resume(&workers[0], resume_request, resume_response, server_resume_key));
+		assert(0 == tabby_client_resume_handshake(&c, client_secret_key, resume_response, client_resume_key));
+		assert(0 == memcmp(server_resume_key, client_resume_key, 32));
+
+		// Corrupted tickets should be rejected
+		resume_request[ii % 48] ^= 4;
+		assert(0 != tabby_server_resume(&s, resume_request, resume_response, server_resume_key));
+
+		// Corrupted server responses should be rejected
+		resume_request[ii % 48] ^= 4;
+		assert(0 == tabby_server_resume(&s, resume_request, resume_response, server_resume_key));
+		resume_response[ii % 64] ^= 2;
+		assert(0 != tabby_client_resume_handshake(&c, client_secret_key, resume_response, client_resume_key));
+	}
+
+	// Tickets survive one rekey but not two
+	{
+		char server_response[128];
+		char server_secret_key[32], client_secret_key[32];
+		char ticket[48], resume_request[80], resume_response[64], resume_key[32];
+
+		assert(0 == tabby_client_rekey(&c, &c, 0, 0, client_request));
+		assert(0 == tabby_server_handshake(&s, client_request, server_response, server_secret_key));
+		assert(0 == tabby_client_handshake(&c, public_key, server_response, client_secret_key));
+		assert(0 == tabby_server_ticket(&s, server_secret_key, ticket));
+		assert(0 == tabby_client_resume(&c, ticket, resume_request));
+
+		assert(0 == tabby_server_rekey(&s, 0, 0));
+		assert(0 == tabby_server_resume(&s, resume_request, resume_response, resume_key));
+		assert(0 == tabby_server_rekey(&s, 0, 0));
+		assert(0 != tabby_server_resume(&s, resume_request, resume_response, resume_key));
+	}
+
+	u32 mt = quick_select(&tt[0], (int)tt.size());
+	wt /= tt.size();
+	u32 mu = quick_select(&tu[0], (int)tu.size());
+	wu /= tu.size();
+	u32 mq = quick_select(&tq[0], (int)tq.size());
+	wq /= tq.size();
+
+	cout << "+ Tabby server ticket: `" << dec << mt << "` median cycles, `" << wt << "` avg usec" << endl;
+	cout << "+ Tabby server resume: `" << dec << mu << "` median cycles, `" << wu << "` avg usec" << endl;
+	cout << "+ Tabby client resume: `" << dec << mq << "` median cycles, `" << wq << "` avg usec" << endl;
+
+	// Multi-identity host test:
+
+	static const int IDENTITY_COUNT = 32;
+
+	tabby_host h;
+	char identity_keys[IDENTITY_COUNT][64];
+
+	assert(0 == tabby_host_gen(&h, &s, IDENTITY_COUNT));
+	assert(0 == tabby_host_get_public_key(&h, 0, identity_keys[0]));
+	assert(0 == memcmp(identity_keys[0], public_key, 64));
+
+	for (int ii = 1; ii < IDENTITY_COUNT; ++ii) {
+		tabby_server identity;
+		char server_data[64];
+
+		assert(0 == tabby_server_gen(&identity, 0, 0));
+		assert(0 == tabby_server_save_secret(&identity, server_data));
+		assert(0 == tabby_server_get_public_key(&identity, identity_keys[ii]));
+		tabby_erase(&identity, sizeof(identity));
+
+		assert(ii == tabby_host_add(&h, server_data));
+
+		// Adding the same identity again should fail
+		assert(-1 == tabby_host_add(&h, server_data));
+	}
+
+	// Host is full
+	{
+		char server_data[64];
+		assert(0 == tabby_server_save_secret(&s, server_data));
+		assert(-1 == tabby_host_add(&h, server_data));
+	}
+
+	vector<u32> tf;
+	double wf = 0;
+
+	for (int ii = 0; ii < 1000; ++ii) {
+		const int expected_id = ii % IDENTITY_COUNT;
+
+		t0 = m_clock.usec();
+		c0 = Clock::cycles();
+
+		const int key_id = tabby_host_find(&h, identity_keys[expected_id]);
+
+		c1 = Clock::cycles();
+		t1 = m_clock.usec();
+
+		tf.push_back(c1 - c0);
+		wf += t1 - t0;
+
+		assert(key_id == expected_id);
+
+		assert(0 == tabby_client_rekey(&c, &c, 0, 0, client_request));
+
+		char server_response[128];
+		char server_secret_key[32], client_secret_key[32];
+
+		if (ii & 1) {
+			assert(0 == tabby_host_worker_handshake(&h, &workers[ii % WORKER_COUNT], key_id, client_request, server_response, server_secret_key));
+		} else {
+			assert(0 == tabby_host_handshake(&h, key_id, client_request, server_response, server_secret_key));
+		}
+
+		assert(0 == tabby_client_handshake(&c, identity_keys[key_id], server_response, client_secret_key));
+		assert(0 == memcmp(server_secret_key, client_secret_key, 32));
+
+		// Client expecting another identity should reject the response
+		assert(0 != tabby_client_handshake(&c, identity_keys[(key_id + 1) % IDENTITY_COUNT], server_response, client_secret_key));
+	}
+
+	{
+		char unknown_hint[8] = {0};
+		char server_response[128];
+		char server_secret_key[32];
+
+		assert(-1 == tabby_host_find(&h, unknown_hint));
+		assert(0 != tabby_host_handshake(&h, IDENTITY_COUNT, client_request, server_response, server_secret_key));
+	}
+
+	tabby_host_free(&h);
+
+	u32 mf = quick_select(&tf[0], (int)tf.size());
+	wf /= tf.size();
+
+	cout << "+ Tabby host identity lookup: `" << dec << mf << "` median cycles, `" << wf << "` avg usec" << endl;
 
 
 	// Password authentication: